@@ -0,0 +1,135 @@
+//
+// Huge page backed arena for the block buffers.
+//
+
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "common.h"
+
+#define HUGEPAGE        (2UL << 20)
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED  (1)
+#endif
+
+enum { CHUNK_HUGETLB, CHUNK_THP, CHUNK_HEAP };
+
+static const char *ChunkNames[] = {
+        [CHUNK_HUGETLB] = "hugetlb",
+        [CHUNK_THP]     = "thp",
+        [CHUNK_HEAP]    = "heap",
+};
+
+typedef struct {
+    iqueue_head qnode;
+    void *base;
+    size_t len;
+    int how;
+} ArenaChunk;
+
+// The node of the CPU we run on if the thread is pinned to fewer CPUs than
+// are online, -1 if it may run anywhere.
+int Arena_LocalNode(void)
+{
+    cpu_set_t set;
+    unsigned cpu, node;
+
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) return -1;
+    if (CPU_COUNT(&set) >= sysconf(_SC_NPROCESSORS_ONLN)) return -1;
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0) return -1;
+    return (int)node;
+}
+
+void Arena_Init(Arena *arena, size_t bufsize, int node)
+{
+    iqueue_init(&arena->free);
+    iqueue_init(&arena->chunks);
+    arena->bufsize = (max(bufsize, sizeof(iqueue_head)) + 63) & ~(size_t)63;
+    arena->chunksize = (arena->bufsize + HUGEPAGE - 1) & ~(HUGEPAGE - 1);
+    arena->node = node;
+    arena->nfree = arena->ntotal = 0;
+}
+
+void Arena_Release(Arena *arena)
+{
+    while (!iqueue_is_empty(&arena->chunks)) {
+        ArenaChunk *chunk = iqueue_entry(arena->chunks.next, ArenaChunk, qnode);
+        iqueue_del(&chunk->qnode);
+        if (chunk->how == CHUNK_HEAP) free(chunk->base);
+        else munmap(chunk->base, chunk->len);
+        free(chunk);
+    }
+
+    iqueue_init(&arena->free);
+    arena->nfree = arena->ntotal = 0;
+}
+
+// Explicit huge pages if any are reserved, else a huge page aligned mapping
+// the kernel may back with transparent huge pages, else the heap.
+static void *MapChunk(size_t len, int *how)
+{
+    void *p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+        *how = CHUNK_HUGETLB;
+        return p;
+    }
+
+    p = mmap(NULL, len + HUGEPAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p != MAP_FAILED) {
+        uintptr_t head = (uintptr_t)p, aligned = (head + HUGEPAGE - 1) & ~(HUGEPAGE - 1);
+        if (aligned > head) munmap(p, aligned - head);
+        munmap((void *)(aligned + len), head + HUGEPAGE - aligned);
+        madvise((void *)aligned, len, MADV_HUGEPAGE);
+        *how = CHUNK_THP;
+        return (void *)aligned;
+    }
+
+    *how = CHUNK_HEAP;
+    if (posix_memalign(&p, HUGEPAGE, len) != 0) return NULL;
+    return p;
+}
+
+static void Arena_Grow(Arena *arena)
+{
+    ArenaChunk *chunk = malloc(sizeof(ArenaChunk));
+    assert(chunk != NULL);
+    chunk->len = arena->chunksize;
+    chunk->base = MapChunk(chunk->len, &chunk->how);
+    assert(chunk->base != NULL);
+    iqueue_add_tail(&chunk->qnode, &arena->chunks);
+
+    // a preference rather than a bind, a full node falls back to the others
+    if (arena->node >= 0 && chunk->how != CHUNK_HEAP) {
+        unsigned long mask = 1UL << arena->node;
+        syscall(SYS_mbind, chunk->base, chunk->len, MPOL_PREFERRED, &mask, sizeof(mask) * 8, 0);
+    }
+
+    uint32_t nbuf = (uint32_t)(chunk->len / arena->bufsize);
+    for (uint32_t i = 0; i < nbuf; i++)
+        iqueue_add_tail((iqueue_head *)(chunk->base + i * arena->bufsize), &arena->free);
+    arena->nfree += nbuf;
+    arena->ntotal += nbuf;
+
+    debug("%zu KB chunk, %s, node %d, %u buffers\n", chunk->len >> 10,
+          ChunkNames[chunk->how], arena->node, arena->ntotal);
+}
+
+void *Arena_Get(Arena *arena)
+{
+    if (iqueue_is_empty(&arena->free))
+        Arena_Grow(arena);
+
+    iqueue_head *buf = arena->free.next;
+    iqueue_del(buf);
+    arena->nfree--;
+
+    return buf;
+}
+
+void Arena_Put(Arena *arena, void *buf)
+{
+    iqueue_add((iqueue_head *) buf, &arena->free);
+    arena->nfree++;
+}
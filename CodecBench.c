@@ -0,0 +1,150 @@
+//
+// Throughput of the in-tree kodoc backend for every SIMD kernel this CPU
+// supports. Usage: CodecBench [symbols] [symbol_size]
+//
+
+#include <time.h>
+#include "common.h"
+#include "kodoc/gf.h"
+
+#define BATCH   (8)
+
+static double Now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double BenchMulAdd(uint32_t symbols, uint32_t symbolsize)
+{
+    uint8_t *src = malloc(symbols * symbolsize), *dst = malloc(symbolsize);
+    for (uint32_t i = 0; i < symbols * symbolsize; i++) src[i] = (uint8_t)rand();
+    memset(dst, 0, symbolsize);
+
+    size_t bytes = 0;
+    double start = Now();
+    for (int round = 0; round < 64; round++) {
+        for (uint32_t i = 0; i < symbols; i++)
+            gf256_region_muladd(dst, src + i * symbolsize, (uint8_t)(i | 2), symbolsize);
+        bytes += (size_t)symbols * symbolsize;
+    }
+    double elapsed = Now() - start;
+
+    free(src);
+    free(dst);
+    return bytes / elapsed / 1e9;
+}
+
+static void BenchCodec(int32_t field, uint32_t symbols, uint32_t symbolsize,
+                       double *enc_gbps, double *batch_gbps, double *dec_gbps, double *sys_gbps)
+{
+    // GF(2) needs a few more packets to reach full rank
+    const int npkts = symbols + 64;
+
+    kodoc_factory_t ef = kodoc_new_encoder_factory(kodoc_full_vector, field, symbols, symbolsize);
+    kodoc_factory_t df = kodoc_new_decoder_factory(kodoc_full_vector, field, symbols, symbolsize);
+    assert(ef != NULL && df != NULL);
+
+    uint32_t blksize = symbols * symbolsize, payload_size = kodoc_factory_max_payload_size(ef);
+    uint8_t *blk = malloc(blksize), *out = malloc(blksize);
+    uint8_t *payloads = malloc((size_t)npkts * payload_size);
+    for (uint32_t i = 0; i < blksize; i++) blk[i] = (uint8_t)rand();
+
+    kodoc_coder_t enc = kodoc_factory_build_coder(ef);
+    kodoc_set_const_symbols(enc, blk, blksize);
+
+    double start = Now();
+    for (int i = 0; i < npkts; i++)
+        kodoc_write_payload(enc, payloads + (size_t)i * payload_size);
+    *enc_gbps = (double)npkts * symbolsize / (Now() - start) / 1e9;
+
+    // same packets, BATCH per pass over the block; the decoder below checks them
+    kodoc_coder_t batchenc = kodoc_factory_build_coder(ef);
+    kodoc_set_const_symbols(batchenc, blk, blksize);
+
+    start = Now();
+    for (int i = 0; i < npkts; i += BATCH) {
+        uint8_t *ptrs[BATCH];
+        uint32_t sizes[BATCH], k = min(BATCH, npkts - i);
+        for (uint32_t j = 0; j < k; j++) ptrs[j] = payloads + (size_t)(i + j) * payload_size;
+        kodoc_write_payloads(batchenc, ptrs, sizes, k);
+    }
+    *batch_gbps = (double)npkts * symbolsize / (Now() - start) / 1e9;
+
+    kodoc_coder_t dec = kodoc_factory_build_coder(df);
+    kodoc_set_mutable_symbols(dec, out, blksize);
+
+    // the decoder clobbers the payloads, so time it on a copy
+    uint8_t *copies = malloc((size_t)npkts * payload_size);
+    memcpy(copies, payloads, (size_t)npkts * payload_size);
+
+    start = Now();
+    for (int i = 0; i < npkts && !kodoc_is_complete(dec); i++)
+        kodoc_read_payload(dec, copies + (size_t)i * payload_size);
+    *dec_gbps = (double)blksize / (Now() - start) / 1e9;
+
+    assert(kodoc_is_complete(dec));
+    assert(memcmp(blk, out, blksize) == 0);
+
+    // systematic: every symbol arrives uncoded, no elimination at all
+    kodoc_coder_t sysenc = kodoc_factory_build_coder(ef);
+    kodoc_set_systematic_on(sysenc);
+    kodoc_set_const_symbols(sysenc, blk, blksize);
+    for (uint32_t i = 0; i < symbols; i++)
+        kodoc_write_payload(sysenc, payloads + (size_t)i * payload_size);
+
+    kodoc_coder_t sysdec = kodoc_factory_build_coder(df);
+    memset(out, 0, blksize);
+    kodoc_set_mutable_symbols(sysdec, out, blksize);
+
+    start = Now();
+    for (uint32_t i = 0; i < symbols; i++)
+        kodoc_read_payload(sysdec, payloads + (size_t)i * payload_size);
+    *sys_gbps = (double)blksize / (Now() - start) / 1e9;
+
+    assert(kodoc_is_complete(sysdec));
+    assert(memcmp(blk, out, blksize) == 0);
+
+    kodoc_delete_coder(batchenc);
+    kodoc_delete_coder(sysenc);
+    kodoc_delete_coder(sysdec);
+    kodoc_delete_coder(enc);
+    kodoc_delete_coder(dec);
+    kodoc_delete_factory(ef);
+    kodoc_delete_factory(df);
+    free(copies);
+    free(payloads);
+    free(out);
+    free(blk);
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t symbols = argc > 1 ? (uint32_t)atoi(argv[1]) : MAXSYMBOL;
+    uint32_t symbolsize = argc > 2 ? (uint32_t)atoi(argv[2]) : MAXSYMBOLSIZE;
+
+    gf_init();
+
+    static const struct { int32_t field; const char *name; } fields[] = {
+            { kodoc_binary, "binary" }, { kodoc_binary4, "binary4" }, { kodoc_binary8, "binary8" },
+    };
+
+    printf("generation: %u x %u bytes\n", symbols, symbolsize);
+    printf("%-8s %-8s %14s %14s %14s %14s %14s\n", "kernel", "field",
+           "muladd GB/s", "encode GB/s", "batch GB/s", "decode GB/s", "sys dec GB/s");
+
+    for (const gf_kernel * const *k = gf_kernels(); *k != NULL; k++) {
+        gf_select_kernel((*k)->name);
+
+        double muladd = BenchMulAdd(symbols, symbolsize), enc, batch, dec, sys;
+
+        for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++) {
+            BenchCodec(fields[f].field, symbols, symbolsize, &enc, &batch, &dec, &sys);
+            printf("%-8s %-8s %14.3f %14.3f %14.3f %14.3f %14.3f\n", (*k)->name, fields[f].name,
+                   muladd, enc, batch, dec, sys);
+        }
+    }
+
+    return 0;
+}
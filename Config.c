@@ -0,0 +1,182 @@
+//
+// Connection parameters shared by Sender and Receiver.
+//
+
+#include <getopt.h>
+#include "common.h"
+
+static const char *CodecNames[] = {
+        [kodoc_full_vector]     = "full_vector",
+        [kodoc_on_the_fly]      = "on_the_fly",
+        [kodoc_sliding_window]  = "sliding_window",
+        [kodoc_sparse_full_vector] = "sparse_full_vector",
+        [kodoc_seed]            = "seed",
+        [kodoc_sparse_seed]     = "sparse_seed",
+        [kodoc_reed_solomon]    = "reed_solomon",
+};
+
+static const char *FieldNames[] = {
+        [kodoc_binary]  = "binary",
+        [kodoc_binary4] = "binary4",
+        [kodoc_binary8] = "binary8",
+};
+
+static const char *BackendNames[] = {
+        [IO_EPOLL]      = "epoll",
+        [IO_URING]      = "uring",
+};
+
+static int32_t LookupName(const char *names[], size_t cnt, const char *name)
+{
+    for (size_t i = 0; i < cnt; i++)
+        if (names[i] != NULL && strcmp(names[i], name) == 0) return (int32_t)i;
+    return -1;
+}
+
+static void Usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-c codec] [-f field] [-n symbols] [-s symbolsize] [-S 0|1] [-d density] [-b spare]\n", prog);
+    fprintf(stderr, "       [-g 0|1] [-p 0|1] [-i backend] [-H address] [-P port] [-w workers]\n");
+    fprintf(stderr, "       [-e encoders] [-j decoders] [-a packets] [-A ms]\n");
+    fprintf(stderr, "  codec: full_vector | on_the_fly | sparse_full_vector | seed | sparse_seed |\n");
+    fprintf(stderr, "         sliding_window | reed_solomon\n");
+    fprintf(stderr, "  field: binary | binary4 | binary8, reed_solomon takes binary8 only\n");
+    fprintf(stderr, "  -n: symbols per block, up to %d, %d for reed_solomon\n", MAXSYMBOL, RSMAXSYMBOL);
+    fprintf(stderr, "  -s: bytes per symbol, %d to %d\n", MINSYMBOLSIZE, MAXSYMBOLSIZE);
+    fprintf(stderr, "  -S: systematic transmission, on by default\n");
+    fprintf(stderr, "  -d: coefficient density of the sparse codecs, 0 < density <= 1,\n");
+    fprintf(stderr, "      adapts to the loss rate when 0 (default)\n");
+    fprintf(stderr, "  -b: retired blocks kept for reuse, 0 to %d, %d by default\n", RXWINDOW, SPAREBLOCKS);
+    fprintf(stderr, "  -g: UDP segmentation and receive offload, on by default\n");
+    fprintf(stderr, "  -p: busy poll the sockets instead of sleeping, off by default\n");
+    fprintf(stderr, "  -i: socket I/O through epoll (default) or uring\n");
+    fprintf(stderr, "  -H: IPv4 address the sender sends to, %s by default, or the receiver\n", DST_IP);
+    fprintf(stderr, "      listens on, any by default\n");
+    fprintf(stderr, "  -P: UDP port of the receiver, %d by default\n", DST_DPORT);
+    fprintf(stderr, "  -w: receiver threads, one per core, sharing the port by connection, 1 by default\n");
+    fprintf(stderr, "  -e: sender threads encoding repairs off the pacing thread, none by default\n");
+    fprintf(stderr, "  -j: receiver threads per worker decoding blocks in parallel, none by default\n");
+    fprintf(stderr, "  -a: packets a receiver acks with one ack at most, %d by default\n", ACKEVERY);
+    fprintf(stderr, "  -A: ms a receiver delays an ack at most, %d by default, %d at most, a decoded\n",
+            ACKDELAY, ACKMAXDELAY);
+    fprintf(stderr, "      block is acked at once\n");
+    exit(EXIT_FAILURE);
+}
+
+void LRTConfig_Default(LRTConfig *cfg)
+{
+    // 9 bytes of coding header instead of a full coefficient vector, and
+    // repairs only as dense as the receiver needs them
+    cfg->codec = kodoc_sparse_seed;
+    cfg->field = kodoc_binary8;
+    cfg->maxsymbol = MAXSYMBOL;
+    cfg->maxsymbolsize = MAXSYMBOLSIZE;
+    cfg->systematic = true;
+    cfg->density = 0;
+    cfg->spare = SPAREBLOCKS;
+    cfg->offload = true;
+    cfg->busypoll = false;
+    cfg->backend = IO_EPOLL;
+    cfg->host = NULL;
+    cfg->port = DST_DPORT;
+    cfg->workers = 1;
+    cfg->encoders = 0;
+    cfg->decoders = 0;
+    cfg->ackevery = ACKEVERY;
+    cfg->ackdelay = ACKDELAY;
+}
+
+void LRTConfig_Parse(LRTConfig *cfg, int argc, char *argv[])
+{
+    int opt;
+    bool nset = false, fset = false;
+
+    while ((opt = getopt(argc, argv, "c:f:n:s:S:d:b:g:p:i:H:P:w:e:j:a:A:")) != -1) {
+        switch (opt) {
+            case 'c':
+                cfg->codec = LookupName(CodecNames, sizeof(CodecNames) / sizeof(CodecNames[0]), optarg);
+                if (cfg->codec < 0 || !kodoc_has_codec(cfg->codec)) Usage(argv[0]);
+                break;
+            case 'f':
+                cfg->field = LookupName(FieldNames, sizeof(FieldNames) / sizeof(FieldNames[0]), optarg);
+                if (cfg->field < 0) Usage(argv[0]);
+                fset = true;
+                break;
+            case 'n':
+                cfg->maxsymbol = (uint32_t)atoi(optarg);
+                if (cfg->maxsymbol == 0 || cfg->maxsymbol > MAXSYMBOL) Usage(argv[0]);
+                nset = true;
+                break;
+            case 's':
+                cfg->maxsymbolsize = (uint32_t)atoi(optarg);
+                if (cfg->maxsymbolsize < MINSYMBOLSIZE || cfg->maxsymbolsize > MAXSYMBOLSIZE) Usage(argv[0]);
+                break;
+            case 'S':
+                cfg->systematic = atoi(optarg) != 0;
+                break;
+            case 'd':
+                cfg->density = atof(optarg);
+                if (!(cfg->density >= 0.0 && cfg->density <= 1.0)) Usage(argv[0]);
+                break;
+            case 'b':
+                // more than a window's worth would never be taken again
+                if (atoi(optarg) < 0 || atoi(optarg) > RXWINDOW) Usage(argv[0]);
+                cfg->spare = (uint32_t)atoi(optarg);
+                break;
+            case 'g':
+                cfg->offload = atoi(optarg) != 0;
+                break;
+            case 'p':
+                cfg->busypoll = atoi(optarg) != 0;
+                break;
+            case 'i':
+                cfg->backend = LookupName(BackendNames, sizeof(BackendNames) / sizeof(BackendNames[0]), optarg);
+                if (cfg->backend < 0) Usage(argv[0]);
+                break;
+            case 'H':
+                cfg->host = optarg;
+                break;
+            case 'P':
+                if (atoi(optarg) <= 0 || atoi(optarg) > UINT16_MAX) Usage(argv[0]);
+                cfg->port = (uint16_t)atoi(optarg);
+                break;
+            case 'w':
+                cfg->workers = (uint32_t)atoi(optarg);
+                if (cfg->workers == 0 || cfg->workers > MAXWORKERS) Usage(argv[0]);
+                break;
+            case 'e':
+                cfg->encoders = (uint32_t)atoi(optarg);
+                if (cfg->encoders > MAXWORKERS) Usage(argv[0]);
+                break;
+            case 'j':
+                cfg->decoders = (uint32_t)atoi(optarg);
+                if (cfg->decoders > MAXWORKERS) Usage(argv[0]);
+                break;
+            case 'a':
+                cfg->ackevery = (uint32_t)atoi(optarg);
+                if (cfg->ackevery == 0) Usage(argv[0]);
+                break;
+            case 'A':
+                if (atoi(optarg) < 0 || atoi(optarg) > ACKMAXDELAY) Usage(argv[0]);
+                cfg->ackdelay = (uint32_t)atoi(optarg);
+                break;
+            default:
+                Usage(argv[0]);
+        }
+    }
+
+    // Reed-Solomon is GF(2^8) only and has no repair rows left at 256
+    // symbols, only the defaults give way to it
+    if (cfg->codec == kodoc_reed_solomon) {
+        if ((fset && cfg->field != kodoc_binary8) || (nset && cfg->maxsymbol > RSMAXSYMBOL))
+            Usage(argv[0]);
+        if (cfg->maxsymbol > RSMAXSYMBOL)
+            debug("reed_solomon takes %d symbols per block at most, not %u\n", RSMAXSYMBOL, cfg->maxsymbol);
+        cfg->field = kodoc_binary8;
+        cfg->maxsymbol = min(cfg->maxsymbol, RSMAXSYMBOL);
+    }
+
+    debug("codec %s, field %s, %u x %u, systematic %s, density %.3f, spare %u\n", CodecNames[cfg->codec],
+          FieldNames[cfg->field], cfg->maxsymbol, cfg->maxsymbolsize, cfg->systematic ? "on" : "off",
+          cfg->density, cfg->spare);
+}
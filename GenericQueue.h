@@ -94,4 +94,171 @@ typedef struct IQUEUEHEAD iqueue_head;
 	iqueue_splice(list, head);	iqueue_init(list); } while (0)
 
 
+//---------------------------------------------------------------------
+// bounded rings of pointers, lock free, for handing work between threads
+//---------------------------------------------------------------------
+#define ICACHELINE	64
+
+// Each side keeps to a cache line of its own and looks at the other's only
+// when its cached copy says the ring is full, or empty.
+struct ISPSCRING {
+	unsigned int head __attribute__((aligned(ICACHELINE)));	// consumer's
+	unsigned int tailcache;
+	unsigned int tail __attribute__((aligned(ICACHELINE)));	// producer's
+	unsigned int headcache;
+	unsigned int mask __attribute__((aligned(ICACHELINE)));
+	void **slots;
+};
+
+typedef struct ISPSCRING ispsc_ring;
+
+// 'slots' is an array of 'size' pointers, 'size' a power of 2
+#define ISPSC_INIT(ring, slotv, size) ( \
+	(ring)->head = (ring)->tail = 0, \
+	(ring)->headcache = (ring)->tailcache = 0, \
+	(ring)->mask = (size) - 1, (ring)->slots = (void **)(slotv))
+
+// slots the producer may fill at tail 't', at least 'want' if there are
+#define ISPSC_ROOM(ring, t, want) ({ \
+	unsigned int __room = (ring)->mask + 1 - ((t) - (ring)->headcache); \
+	if (__room < (want)) { \
+		(ring)->headcache = __atomic_load_n(&(ring)->head, __ATOMIC_ACQUIRE); \
+		__room = (ring)->mask + 1 - ((t) - (ring)->headcache); } \
+	__room; })
+
+// items the consumer may take at head 'h', at least 'want' if there are
+#define ISPSC_AVAIL(ring, h, want) ({ \
+	unsigned int __avail = (ring)->tailcache - (h); \
+	if (__avail < (want)) { \
+		(ring)->tailcache = __atomic_load_n(&(ring)->tail, __ATOMIC_ACQUIRE); \
+		__avail = (ring)->tailcache - (h); } \
+	__avail; })
+
+// false if the ring is full
+#define ISPSC_PUSH(ring, item) ({ \
+	unsigned int __t = (ring)->tail; \
+	int __ok = ISPSC_ROOM(ring, __t, 1) > 0; \
+	if (__ok) { \
+		(ring)->slots[__t & (ring)->mask] = (item); \
+		__atomic_store_n(&(ring)->tail, __t + 1, __ATOMIC_RELEASE); } \
+	__ok; })
+
+// NULL if the ring is empty
+#define ISPSC_POP(ring) ({ \
+	unsigned int __h = (ring)->head; void *__p = 0; \
+	if (ISPSC_AVAIL(ring, __h, 1) > 0) { \
+		__p = (ring)->slots[__h & (ring)->mask]; \
+		__atomic_store_n(&(ring)->head, __h + 1, __ATOMIC_RELEASE); } \
+	__p; })
+
+// Pushes up to 'n' of 'items' with a single release, returns how many.
+#define ISPSC_PUSH_BATCH(ring, items, n) ({ \
+	unsigned int __t = (ring)->tail, __n = (n), __k, __i; \
+	__k = ISPSC_ROOM(ring, __t, __n); \
+	if (__k > __n) __k = __n; \
+	for (__i = 0; __i < __k; __i++) \
+		(ring)->slots[(__t + __i) & (ring)->mask] = (items)[__i]; \
+	if (__k > 0) __atomic_store_n(&(ring)->tail, __t + __k, __ATOMIC_RELEASE); \
+	__k; })
+
+// Pops up to 'n' into 'items' with a single release, returns how many.
+#define ISPSC_POP_BATCH(ring, items, n) ({ \
+	unsigned int __h = (ring)->head, __n = (n), __k, __i; \
+	__k = ISPSC_AVAIL(ring, __h, __n); \
+	if (__k > __n) __k = __n; \
+	for (__i = 0; __i < __k; __i++) \
+		(items)[__i] = (ring)->slots[(__h + __i) & (ring)->mask]; \
+	if (__k > 0) __atomic_store_n(&(ring)->head, __h + __k, __ATOMIC_RELEASE); \
+	__k; })
+
+#define ispsc_init	ISPSC_INIT
+#define ispsc_push	ISPSC_PUSH
+#define ispsc_pop	ISPSC_POP
+#define ispsc_push_batch	ISPSC_PUSH_BATCH
+#define ispsc_pop_batch	ISPSC_POP_BATCH
+
+// Any number of producers and consumers. A cell's sequence number tells
+// whose turn it is: its position for a producer, one past for a consumer.
+struct IMPMCCELL {
+	unsigned int seq;
+	void *item;
+};
+
+struct IMPMCRING {
+	unsigned int head __attribute__((aligned(ICACHELINE)));	// consumers'
+	unsigned int tail __attribute__((aligned(ICACHELINE)));	// producers'
+	unsigned int mask __attribute__((aligned(ICACHELINE)));
+	struct IMPMCCELL *cells;
+};
+
+typedef struct IMPMCCELL impmc_cell;
+typedef struct IMPMCRING impmc_ring;
+
+// 'cells' is an array of 'size' cells, 'size' a power of 2
+#define IMPMC_INIT(ring, cellv, size) do { \
+	unsigned int __i; \
+	(ring)->head = (ring)->tail = 0; \
+	(ring)->mask = (size) - 1; (ring)->cells = (cellv); \
+	for (__i = 0; __i < (size); __i++) (ring)->cells[__i].seq = __i; \
+	} while (0)
+
+// Claims up to 'want' cells from position '*pos' on, as many in a row as
+// have sequence numbers 'lag' past their positions, moves '*pos' past them
+// and sets 'first' to the first one. Returns how many, 0 if none has.
+#define IMPMC_CLAIM(ring, pos, lag, want, first) ({ \
+	unsigned int __p = __atomic_load_n(pos, __ATOMIC_RELAXED), __c; \
+	for (;;) { \
+		for (__c = 0; __c < (want); __c++) \
+			if (__atomic_load_n(&(ring)->cells[(__p + __c) & (ring)->mask].seq, \
+					__ATOMIC_ACQUIRE) != __p + __c + (lag)) break; \
+		if (__c == 0) { \
+			int __d = (int)(__atomic_load_n(&(ring)->cells[__p & (ring)->mask].seq, \
+					__ATOMIC_ACQUIRE) - (__p + (lag))); \
+			if (__d < 0 || (want) == 0) break; \
+			__p = __atomic_load_n(pos, __ATOMIC_RELAXED); \
+			continue; } \
+		if (__atomic_compare_exchange_n(pos, &__p, __p + __c, 1, \
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED)) break; \
+	} \
+	(first) = __p; \
+	__c; })
+
+// Pushes up to 'n' of 'items', returns how many, 0 if the ring is full.
+#define IMPMC_PUSH_BATCH(ring, items, n) ({ \
+	unsigned int __claimed = 0, __i, __k; \
+	__k = IMPMC_CLAIM(ring, &(ring)->tail, 0, (n), __claimed); \
+	for (__i = 0; __i < __k; __i++) { \
+		struct IMPMCCELL *__cell = &(ring)->cells[(__claimed + __i) & (ring)->mask]; \
+		__cell->item = (items)[__i]; \
+		__atomic_store_n(&__cell->seq, __claimed + __i + 1, __ATOMIC_RELEASE); } \
+	__k; })
+
+// Pops up to 'n' into 'items', returns how many, 0 if the ring is empty.
+#define IMPMC_POP_BATCH(ring, items, n) ({ \
+	unsigned int __claimed = 0, __i, __k; \
+	__k = IMPMC_CLAIM(ring, &(ring)->head, 1, (n), __claimed); \
+	for (__i = 0; __i < __k; __i++) { \
+		struct IMPMCCELL *__cell = &(ring)->cells[(__claimed + __i) & (ring)->mask]; \
+		(items)[__i] = __cell->item; \
+		__atomic_store_n(&__cell->seq, __claimed + __i + (ring)->mask + 1, __ATOMIC_RELEASE); } \
+	__k; })
+
+// false if the ring is full
+#define IMPMC_PUSH(ring, item) ({ \
+	void *__item = (item); \
+	IMPMC_PUSH_BATCH(ring, &__item, 1) == 1; })
+
+// NULL if the ring is empty
+#define IMPMC_POP(ring) ({ \
+	void *__item = 0; \
+	IMPMC_POP_BATCH(ring, &__item, 1); \
+	__item; })
+
+#define impmc_init	IMPMC_INIT
+#define impmc_push	IMPMC_PUSH
+#define impmc_pop	IMPMC_POP
+#define impmc_push_batch	IMPMC_PUSH_BATCH
+#define impmc_pop_batch	IMPMC_POP_BATCH
+
+
 #endif //LLRTP_GENERICQUEUE_H
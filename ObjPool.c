@@ -0,0 +1,66 @@
+//
+// Fixed-size object pools for the per-packet structures.
+//
+
+#include "common.h"
+
+// Objects are handed out from slabs of POOLSLAB at a time and never
+// returned to the heap before ObjPool_Release().
+#define POOLSLAB    (64)
+
+void ObjPool_Init(ObjPool *pool, size_t objsize)
+{
+    assert(objsize >= sizeof(iqueue_head));
+
+    iqueue_init(&pool->free);
+    iqueue_init(&pool->slabs);
+    pool->objsize = (objsize + 15) & ~(size_t)15;
+    pool->nfree = pool->ntotal = 0;
+}
+
+void ObjPool_Release(ObjPool *pool)
+{
+    while (!iqueue_is_empty(&pool->slabs)) {
+        iqueue_head *slab = pool->slabs.next;
+        iqueue_del(slab);
+        free(slab);
+    }
+
+    iqueue_init(&pool->free);
+    pool->nfree = pool->ntotal = 0;
+}
+
+static void ObjPool_Grow(ObjPool *pool)
+{
+    // keep the objects 16 byte aligned behind the slab link
+    void *slab = malloc(16 + POOLSLAB * pool->objsize);
+    assert(slab != NULL);
+    iqueue_add_tail((iqueue_head *) slab, &pool->slabs);
+
+    for (uint32_t i = 0; i < POOLSLAB; i++) {
+        iqueue_head *obj = slab + 16 + i * pool->objsize;
+        iqueue_add_tail(obj, &pool->free);
+    }
+
+    pool->nfree += POOLSLAB;
+    pool->ntotal += POOLSLAB;
+}
+
+void *ObjPool_Get(ObjPool *pool)
+{
+    if (iqueue_is_empty(&pool->free))
+        ObjPool_Grow(pool);
+
+    iqueue_head *obj = pool->free.next;
+    iqueue_del(obj);
+    pool->nfree--;
+
+    return obj;
+}
+
+void ObjPool_Put(ObjPool *pool, void *obj)
+{
+    // LIFO, the next Get() reuses whatever is still warm in cache
+    iqueue_add((iqueue_head *) obj, &pool->free);
+    pool->nfree++;
+}
@@ -0,0 +1,244 @@
+//
+// Throughput of the lock-free rings against the intrusive iqueue, on one
+// thread and between threads. Usage: QueueBench [millions of items]
+//
+
+#include <sched.h>
+#include <time.h>
+#include "common.h"
+
+// items in flight, ring capacity and iqueue nodes alike
+#define DEPTH   (1024)
+#define BATCH   (32)
+
+typedef struct {
+    iqueue_head qnode;
+    uint64_t seq;
+} Node;
+
+enum { Q_IQUEUE, Q_SPSC, Q_SPSC_BATCH, Q_MPMC, Q_MPMC_BATCH };
+
+static const char *QueueNames[] = { "iqueue", "spsc", "spsc batch", "mpmc", "mpmc batch" };
+
+typedef struct {
+    int kind;
+    uint64_t count;         // items each producer moves
+
+    // iqueue takes a lock between threads, the rings need none
+    pthread_mutex_t lock;
+    iqueue_head list;
+    ispsc_ring spsc;
+    void *slots[DEPTH];
+    impmc_ring mpmc;
+    impmc_cell cells[DEPTH];
+
+    // every item is a heap node of its own, the way the iqueue users have them
+    Node *nodes[DEPTH];
+    uint64_t sum;
+    uint64_t consumed;      // by all consumers together
+} Bench;
+
+static double Now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void Reset(Bench *b, int kind, uint64_t count)
+{
+    b->kind = kind;
+    b->count = count;
+    b->sum = b->consumed = 0;
+    iqueue_init(&b->list);
+    ispsc_init(&b->spsc, b->slots, DEPTH);
+    impmc_init(&b->mpmc, b->cells, DEPTH);
+}
+
+// Moves up to 'n' items in, returns how many went, threads share a lock.
+static uint32_t Push(Bench *b, Node **items, uint32_t n, bool shared)
+{
+    uint32_t k = 0;
+
+    switch (b->kind) {
+        case Q_IQUEUE:
+            if (shared) pthread_mutex_lock(&b->lock);
+            for (k = 0; k < n; k++) iqueue_add_tail(&items[k]->qnode, &b->list);
+            if (shared) pthread_mutex_unlock(&b->lock);
+            break;
+        case Q_SPSC:
+            while (k < n && ispsc_push(&b->spsc, items[k])) k++;
+            break;
+        case Q_SPSC_BATCH:
+            k = ispsc_push_batch(&b->spsc, items, n);
+            break;
+        case Q_MPMC:
+            while (k < n && impmc_push(&b->mpmc, items[k])) k++;
+            break;
+        case Q_MPMC_BATCH:
+            k = impmc_push_batch(&b->mpmc, items, n);
+            break;
+    }
+    return k;
+}
+
+static uint32_t Pop(Bench *b, Node **items, uint32_t n, bool shared)
+{
+    uint32_t k = 0;
+
+    switch (b->kind) {
+        case Q_IQUEUE:
+            if (shared) pthread_mutex_lock(&b->lock);
+            for (; k < n && !iqueue_is_empty(&b->list); k++) {
+                items[k] = iqueue_entry(b->list.next, Node, qnode);
+                iqueue_del(&items[k]->qnode);
+            }
+            if (shared) pthread_mutex_unlock(&b->lock);
+            break;
+        case Q_SPSC:
+            while (k < n && (items[k] = ispsc_pop(&b->spsc)) != NULL) k++;
+            break;
+        case Q_SPSC_BATCH:
+            k = ispsc_pop_batch(&b->spsc, items, n);
+            break;
+        case Q_MPMC:
+            while (k < n && (items[k] = impmc_pop(&b->mpmc)) != NULL) k++;
+            break;
+        case Q_MPMC_BATCH:
+            k = impmc_pop_batch(&b->mpmc, items, n);
+            break;
+    }
+    return k;
+}
+
+// One thread fills BATCH items and drains them again, cycling through the
+// nodes so that the iqueue walks cold memory like it does in a pipeline.
+static double BenchLocal(Bench *b, int kind, uint64_t count)
+{
+    Node *items[BATCH];
+    uint32_t next = 0;
+
+    Reset(b, kind, count);
+    double start = Now();
+    for (uint64_t done = 0; done < count; done += BATCH) {
+        for (uint32_t i = 0; i < BATCH; i++, next = (next + 1) % DEPTH) {
+            items[i] = b->nodes[next];
+            items[i]->seq = done + i;
+        }
+        uint32_t n = Push(b, items, BATCH, false);
+        assert(n == BATCH);
+        n = Pop(b, items, BATCH, false);
+        assert(n == BATCH);
+        for (uint32_t i = 0; i < n; i++) b->sum += items[i]->seq;
+    }
+    double rate = count / (Now() - start) / 1e6;
+
+    // every item came out once
+    assert(b->sum == count * (count - 1) / 2);
+    return rate;
+}
+
+// Producers own DEPTH / nthread nodes each and get them back from the
+// consumers over a second queue of the same kind, so nothing is allocated
+// while the clock runs.
+typedef struct {
+    Bench *b, *back;
+    uint32_t first, nnode;
+    uint64_t total;         // items all producers move
+    bool producer;
+} Thread;
+
+static void *Run(void *arg)
+{
+    Thread *t = arg;
+    Node *items[BATCH];
+
+    if (t->producer) {
+        uint32_t nfree = t->nnode;
+        Node **pool = malloc(t->nnode * sizeof(Node *));
+        memcpy(pool, &t->b->nodes[t->first], t->nnode * sizeof(Node *));
+        for (uint64_t sent = 0; sent < t->b->count; ) {
+            uint32_t want = (uint32_t)min((uint64_t)BATCH, t->b->count - sent);
+            want = min(want, nfree);
+            for (uint32_t i = 0; i < want; i++) pool[nfree - want + i]->seq = sent + i;
+            uint32_t n = Push(t->b, &pool[nfree - want], want, true);
+            // what did not fit stays at the top of the pool
+            memmove(&pool[nfree - want], &pool[nfree - want + n], (want - n) * sizeof(Node *));
+            nfree -= n;
+            sent += n;
+            // the consumers hand spent nodes back to whichever producer
+            uint32_t back = Pop(t->back, &pool[nfree], min((uint32_t)BATCH, t->nnode - nfree), true);
+            nfree += back;
+            // lets the other side run where the threads share a core
+            if (n == 0 && back == 0) sched_yield();
+        }
+        free(pool);
+        return NULL;
+    }
+
+    uint64_t sum = 0;
+    while (__atomic_load_n(&t->b->consumed, __ATOMIC_RELAXED) < t->total) {
+        uint32_t n = Pop(t->b, items, BATCH, true);
+        for (uint32_t i = 0; i < n; i++) sum += items[i]->seq;
+        for (uint32_t off = 0; off < n; )
+            off += Push(t->back, items + off, n - off, true);
+        if (n > 0) __atomic_add_fetch(&t->b->consumed, n, __ATOMIC_RELAXED);
+        else sched_yield();
+    }
+    __atomic_add_fetch(&t->b->sum, sum, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+static double BenchThreads(Bench *b, Bench *back, int kind, uint64_t count, uint32_t npair)
+{
+    pthread_t threads[2 * MAXWORKERS];
+    Thread args[2 * MAXWORKERS];
+
+    Reset(b, kind, count);
+    Reset(back, kind, count);
+    for (uint32_t i = 0; i < 2 * npair; i++) {
+        args[i].b = b;
+        args[i].back = back;
+        args[i].producer = i < npair;
+        args[i].total = count * npair;
+        args[i].nnode = DEPTH / 2 / npair;
+        args[i].first = (i % npair) * args[i].nnode;
+    }
+
+    double start = Now();
+    for (uint32_t i = 0; i < 2 * npair; i++)
+        pthread_create(&threads[i], NULL, Run, &args[i]);
+    for (uint32_t i = 0; i < 2 * npair; i++)
+        pthread_join(threads[i], NULL);
+    double rate = count * npair / (Now() - start) / 1e6;
+
+    assert(b->sum == npair * (count * (count - 1) / 2));
+    return rate;
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t count = (argc > 1 ? (uint64_t)atoi(argv[1]) : 16) * 1000000;
+    count -= count % BATCH;
+
+    static Bench b, back;
+    pthread_mutex_init(&b.lock, NULL);
+    pthread_mutex_init(&back.lock, NULL);
+    for (int i = 0; i < DEPTH; i++) {
+        b.nodes[i] = malloc(sizeof(Node));
+        assert(b.nodes[i] != NULL);
+    }
+
+    printf("%llu items, %d deep, batches of %d, Mitems/s\n", (unsigned long long)count, DEPTH, BATCH);
+    printf("%-12s %10s %10s %10s\n", "queue", "1 thread", "1P1C", "2P2C");
+    for (int kind = Q_IQUEUE; kind <= Q_MPMC_BATCH; kind++) {
+        printf("%-12s %10.1f", QueueNames[kind], BenchLocal(&b, kind, count));
+        printf(" %10.1f", BenchThreads(&b, &back, kind, count, 1));
+        // a single-producer ring has no business with more
+        if (kind == Q_SPSC || kind == Q_SPSC_BATCH) printf(" %10s\n", "-");
+        else printf(" %10.1f\n", BenchThreads(&b, &back, kind, count, 2));
+    }
+
+    for (int i = 0; i < DEPTH; i++) free(b.nodes[i]);
+    return 0;
+}
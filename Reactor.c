@@ -0,0 +1,102 @@
+//
+// Sleeps until a socket is readable or the next pacing deadline is due.
+//
+
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include "common.h"
+
+// per socket busy polling budget, in us, when the kernel lets us set it
+#define BUSYPOLL_US     (50)
+
+// how long a busy poller spins before it sleeps after all, in ms
+#define BUSYSPIN        (1)
+
+#define MAXEVENTS       (8)
+
+void Reactor_Init(Reactor *reactor, bool busy)
+{
+    reactor->busy = busy;
+    reactor->armed = -1;
+
+    reactor->epfd = epoll_create1(EPOLL_CLOEXEC);
+    assert(reactor->epfd >= 0);
+
+    // deadlines are GetTS() values, so the timer runs on the same clock
+    reactor->timerfd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+    assert(reactor->timerfd >= 0);
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = reactor->timerfd };
+    int rval = epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, reactor->timerfd, &ev);
+    assert(rval == 0);
+}
+
+void Reactor_Release(Reactor *reactor)
+{
+    close(reactor->timerfd);
+    close(reactor->epfd);
+}
+
+void Reactor_Add(Reactor *reactor, int fd)
+{
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = fd };
+    int rval = epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, fd, &ev);
+    assert(rval == 0);
+
+    if (reactor->busy) {
+        // best effort, raising it past net.core.busy_read needs CAP_NET_ADMIN
+        int us = BUSYPOLL_US;
+        setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &us, sizeof(us));
+    }
+}
+
+static void Arm(Reactor *reactor, long deadline)
+{
+    if (deadline == reactor->armed) return;
+
+    // an absolute time in the past fires at once, a zero one disarms
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (deadline >= 0) {
+        its.it_value.tv_sec = deadline / 1000;
+        its.it_value.tv_nsec = (deadline % 1000) * 1000000;
+    }
+    timerfd_settime(reactor->timerfd, TFD_TIMER_ABSTIME, &its, NULL);
+    reactor->armed = deadline;
+}
+
+// Waits up to 'timeout' ms, -1 for good, and consumes a timer expiry.
+static int Poll(Reactor *reactor, int timeout)
+{
+    struct epoll_event ev[MAXEVENTS];
+
+    int n = epoll_wait(reactor->epfd, ev, MAXEVENTS, timeout);
+    for (int i = 0; i < n; i++) {
+        if (ev[i].data.fd != reactor->timerfd) continue;
+        uint64_t expired;
+        read(reactor->timerfd, &expired, sizeof(expired));
+        reactor->armed = -1;
+    }
+    return n;
+}
+
+// Returns once a socket added to the reactor is readable or the GetTS()
+// time 'deadline' has come, -1 waits for the sockets alone. Busy polling
+// spins for BUSYSPIN first, for the wakeup latency it saves, and sleeps
+// only when nothing came, so a quiet connection still gives up its core.
+void Reactor_Wait(Reactor *reactor, long deadline)
+{
+    if (reactor->busy) {
+        long EntTS = GetTS();
+        while (GetTS() - EntTS <= BUSYSPIN) {
+            if (Poll(reactor, 0) > 0) return;
+            if (deadline >= 0 && GetTS() >= deadline) return;
+            // free on a core of our own, lets a peer on a shared one run
+            sched_yield();
+        }
+    }
+
+    Arm(reactor, deadline);
+    Poll(reactor, -1);
+}
@@ -2,308 +2,961 @@
 // Created by Sai Jiang on 17/10/22.
 //
 
+#include <sched.h>
+#include <linux/filter.h>
 #include "common.h"
 
-static const int32_t codec = kodoc_on_the_fly;
+static DecWrapper *BuildDec(Listener *ls)
+{
+    DecWrapper *decwrapper = ObjPool_Get(&ls->DecPool);
+    decwrapper->dec = kodoc_factory_build_coder(ls->dec_factory);
+    decwrapper->pblk = Arena_Get(&ls->BlkArena);
+    return decwrapper;
+}
 
-Receiver * Receiver_Init(uint32_t maxsymbols, uint32_t maxsymbolsize)
+static void FreeDec(Listener *ls, DecWrapper *decwrapper)
 {
-    Receiver *rx = malloc(sizeof(Receiver));
+    Arena_Put(&ls->BlkArena, decwrapper->pblk);
+    kodoc_delete_coder(decwrapper->dec);
+    ObjPool_Put(&ls->DecPool, decwrapper);
+}
 
-    iqueue_init(&rx->pkt_queue);
-    iqueue_init(&rx->dec_queue);
-    iqueue_init(&rx->sym_queue);
-    iqueue_init(&rx->src_queue);
+// Released blocks keep their coder and buffer, up to cfg.spare of them, so
+// that a new block neither builds a coder nor faults in fresh pages. The
+// spares are shared by all connections.
+static void PutDec(Listener *ls, DecWrapper *decwrapper)
+{
+    if (ls->spare_cnt < ls->cfg.spare) {
+        kodoc_reset_coder(decwrapper->dec);
+        iqueue_add(&decwrapper->qnode, &ls->spare_queue);
+        ls->spare_cnt++;
+        return;
+    }
 
-    rx->src_cnt = 0;
+    FreeDec(ls, decwrapper);
+}
 
-    rx->dec_factory = kodoc_new_decoder_factory(codec, kodoc_binary8,
-                                                maxsymbols, maxsymbolsize);
-    rx->maxsymbol = maxsymbols;
-    rx->maxsymbolsize = maxsymbolsize;
-    rx->blksize = rx->maxsymbol * rx->maxsymbolsize;
+static void DecodeBlock(void *ctx, void *task);
 
-    rx->payload_size = kodoc_factory_max_payload_size(rx->dec_factory);
-    rx->pktbuf = malloc(sizeof(Packet) + rx->payload_size);
-    assert(rx->pktbuf != NULL);
+// Hands each datagram to socket conn % workers of the SO_REUSEPORT group,
+// so that a connection always lands on the same worker. The program sees
+// the UDP payload, whose first word is Packet.conn.
+static void SteerByConn(int sock, uint32_t workers)
+{
+    struct sock_filter code[] = {
+            { BPF_LD | BPF_W | BPF_ABS, 0, 0, 0 },
+            { BPF_ALU | BPF_MOD | BPF_K, 0, 0, workers },
+            { BPF_RET | BPF_A, 0, 0, 0 },
+    };
+    struct sock_fprog prog = { .len = sizeof(code) / sizeof(code[0]), .filter = code };
+
+    // without it the kernel still spreads the flows, by their 4-tuple
+    if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) != 0)
+        debug("%s\n", "no reuseport steering, flows go by address hash");
+}
 
-    rx->ExpectedBlockID = rx->ExpectedSymbolID = 0;
+// Listener 'worker' of cfg.workers, bound in that order so that the
+// worker's index is its socket's index in the SO_REUSEPORT group.
+Listener * Listener_Init(const LRTConfig *cfg, uint32_t worker)
+{
+    Listener *ls = malloc(sizeof(Listener));
+
+    ls->cfg = *cfg;
+    ls->worker = worker;
+
+    for (int i = 0; i < CONNBUCKETS; i++)
+        iqueue_init(&ls->conn_table[i]);
+    ls->conn_cnt = 0;
+    iqueue_init(&ls->ready_queue);
+    iqueue_init(&ls->ack_queue);
+    iqueue_init(&ls->idle_queue);
+    ls->ntomb = 0;
+    ls->malformed = 0;
+
+    ls->dec_factory = kodoc_new_decoder_factory(cfg->codec, cfg->field,
+                                                cfg->maxsymbol, cfg->maxsymbolsize);
+    assert(ls->dec_factory != NULL);
+    ls->maxsymbol = cfg->maxsymbol;
+    ls->maxsymbolsize = cfg->maxsymbolsize;
+    ls->blksize = ls->maxsymbol * ls->maxsymbolsize;
+
+    ls->payload_size = kodoc_factory_max_payload_size(ls->dec_factory);
+
+    ObjPool_Init(&ls->ConnPool, sizeof(Receiver));
+    ObjPool_Init(&ls->DecPool, sizeof(DecWrapper));
+    ObjPool_Init(&ls->LentPool, sizeof(LentMsg));
+    Arena_Init(&ls->BlkArena, ls->blksize, Arena_LocalNode());
+
+    iqueue_init(&ls->spare_queue);
+    ls->spare_cnt = 0;
+    while (ls->spare_cnt < ls->cfg.spare) {
+        DecWrapper *decwrapper = BuildDec(ls);
+        memset(decwrapper->pblk, 0, ls->blksize);
+        PutDec(ls, decwrapper);
+    }
 
+    // every connection comes in on this one socket, and is acked from it
     struct sockaddr_in addr;
+    int rval;
 
-    rx->DataSock = socket(PF_INET, SOCK_DGRAM, 0);
+    ls->DataSock = socket(PF_INET, SOCK_DGRAM, 0);
+    if (cfg->workers > 1) {
+        int one = 1;
+        rval = setsockopt(ls->DataSock, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+        assert(rval == 0);
+    }
     memset(&addr, 0, sizeof(addr));
     addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = htons(INADDR_ANY);
-    addr.sin_port = htons(DST_DPORT);
-    assert(bind(rx->DataSock, (struct sockaddr *)&addr, sizeof(addr)) >= 0);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (cfg->host != NULL) {
+        rval = inet_pton(PF_INET, cfg->host, &addr.sin_addr);
+        assert(rval == 1);
+    }
+    addr.sin_port = htons(cfg->port);
+    rval = bind(ls->DataSock, (struct sockaddr *)&addr, sizeof(addr));
+    assert(rval >= 0);
+    if (cfg->workers > 1) SteerByConn(ls->DataSock, cfg->workers);
+
+    int flags = fcntl(ls->DataSock, F_GETFL, 0);
+    fcntl(ls->DataSock, F_SETFL, flags | O_NONBLOCK);
+
+    // with GRO a read may return a whole train of datagrams, see CheckPkt()
+    // a plain multishot receive has no room for the GRO segment size
+    int one = 1;
+    ls->gro = cfg->offload && cfg->backend != IO_URING && setsockopt(ls->DataSock, SOL_UDP, UDP_GRO, &one, sizeof(one)) == 0;
+    ls->rxslot = ls->gro ? UINT16_MAX : sizeof(Packet) + ls->payload_size;
+    ls->pktbuf = malloc(IOBATCH * ls->rxslot);
+    assert(ls->pktbuf != NULL);
+
+    ls->ackbuf = malloc(IOBATCH * ACKMAXLEN);
+    assert(ls->ackbuf != NULL);
+
+    memset(ls->rxmsg, 0, sizeof(ls->rxmsg));
+    memset(ls->ackmsg, 0, sizeof(ls->ackmsg));
+    for (int i = 0; i < IOBATCH; i++) {
+        ls->rxiov[i].iov_base = ls->pktbuf + i * ls->rxslot;
+        ls->rxiov[i].iov_len = ls->rxslot;
+        ls->rxmsg[i].msg_hdr.msg_iov = &ls->rxiov[i];
+        ls->rxmsg[i].msg_hdr.msg_iovlen = 1;
+        ls->rxmsg[i].msg_hdr.msg_name = &ls->rxaddr[i];
+        ls->ackiov[i].iov_base = ls->ackbuf + i * ACKMAXLEN;
+        ls->ackmsg[i].msg_hdr.msg_iov = &ls->ackiov[i];
+        ls->ackmsg[i].msg_hdr.msg_iovlen = 1;
+        ls->ackmsg[i].msg_hdr.msg_name = &ls->ackaddr[i];
+        ls->ackmsg[i].msg_hdr.msg_namelen = sizeof(ls->ackaddr[i]);
+    }
+    ls->ackcnt = 0;
+    debug("GRO %s\n", ls->gro ? "on" : "off");
+
+    WorkPool_Init(&ls->decoders, cfg->decoders, DecodeBlock, ls);
+    ls->batch = malloc(DECBATCH * sizeof(DecItem));
+    ls->tasks = malloc(DECBATCH * sizeof(DecWrapper *));
+    assert(ls->batch != NULL && ls->tasks != NULL);
+    ls->batchcnt = ls->nbid = 0;
+    iqueue_init(&ls->batch_queue);
+
+    ls->backend = cfg->backend;
+    ls->sendring.fd = ls->recvring.fd = -1;
+    if (ls->backend == IO_URING &&
+            !(Uring_Init(&ls->sendring, IOBATCH) && Uring_Init(&ls->recvring, URINGBUFS) &&
+              Uring_RecvMultishot(&ls->recvring, ls->DataSock, URINGBUFS, ls->rxslot,
+                                  sizeof(struct sockaddr_in)))) {
+        debug("%s\n", "io_uring not available, using epoll");
+        Uring_Release(&ls->sendring);
+        Uring_Release(&ls->recvring);
+        ls->backend = IO_EPOLL;
+    }
 
-    rx->SignalSock = socket(PF_INET, SOCK_DGRAM, 0);
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    inet_pton(PF_INET, SRC_IP, &addr.sin_addr);
-    addr.sin_port = htons(SRC_SPORT);
-    connect(rx->SignalSock, (struct sockaddr *)&addr, sizeof(addr));
+    // with io_uring the data shows up on the ring rather than the socket
+    Reactor_Init(&ls->reactor, cfg->busypoll);
+    Reactor_Add(&ls->reactor, ls->backend == IO_URING ? ls->recvring.fd : ls->DataSock);
+
+    return ls;
+}
+
+void Receiver_Release(Receiver *rx);
+
+void Listener_Release(Listener *ls)
+{
+    for (int i = 0; i < CONNBUCKETS; i++)
+        while (!iqueue_is_empty(&ls->conn_table[i]))
+            Receiver_Release(iqueue_entry(ls->conn_table[i].next, Receiver, hnode));
+
+    WorkPool_Release(&ls->decoders);
+    free(ls->batch);
+    free(ls->tasks);
+    Reactor_Release(&ls->reactor);
+    Uring_Release(&ls->sendring);
+    Uring_Release(&ls->recvring);
+    close(ls->DataSock);
+    kodoc_delete_factory(ls->dec_factory);
+    free(ls->pktbuf);
+    free(ls->ackbuf);
+    while (!iqueue_is_empty(&ls->spare_queue)) {
+        DecWrapper *decwrapper = iqueue_entry(ls->spare_queue.next, DecWrapper, qnode);
+        iqueue_del(&decwrapper->qnode);
+        FreeDec(ls, decwrapper);
+    }
+    ObjPool_Release(&ls->ConnPool);
+    ObjPool_Release(&ls->DecPool);
+    ObjPool_Release(&ls->LentPool);
+    Arena_Release(&ls->BlkArena);
+    free(ls);
+}
+
+static iqueue_head *ConnBucket(Listener *ls, uint32_t conn)
+{
+    return &ls->conn_table[(conn * 2654435761u) >> (32 - CONNBITS)];
+}
+
+static Receiver *FindConn(Listener *ls, uint32_t conn)
+{
+    Receiver *rx;
+    iqueue_foreach(rx, ConnBucket(ls, conn), Receiver, hnode)
+        if (rx->conn == conn) return rx;
+    return NULL;
+}
+
+// A connection starts with the first packet of its sender.
+static Receiver *Accept(Listener *ls, uint32_t conn)
+{
+    Receiver *rx = ObjPool_Get(&ls->ConnPool);
+
+    rx->ls = ls;
+    rx->conn = conn;
+    rx->closed = false;
+    iqueue_add(&rx->hnode, ConnBucket(ls, conn));
+    iqueue_init(&rx->rnode);
+    iqueue_init(&rx->anode);
+    rx->unacked = 0;
+    iqueue_add_tail(&rx->inode, &ls->idle_queue);
+    rx->LastHeardTS = GetTS();
+
+    memset(rx->blocks, 0, sizeof(rx->blocks));
+    rx->dec_cnt = 0;
+    iqueue_init(&rx->lent_queue);
 
-    int flags = fcntl(rx->DataSock, F_GETFL, 0);
-    fcntl(rx->DataSock, F_SETFL, flags | O_NONBLOCK);
+    rx->ExpectedBlockID = rx->ExpectedSymbolID = 0;
+    rx->ReadBlockID = rx->ReadSymbolID = rx->ReadOffset = 0;
 
+    debug("conn %08x open on worker %u, total %u\n", conn, ls->worker, ++ls->conn_cnt);
     return rx;
 }
 
+// Lets go of a connection and whatever blocks it still holds, none of them
+// lent out.
 void Receiver_Release(Receiver *rx)
 {
-    assert(iqueue_is_empty(&rx->pkt_queue));
-    assert(iqueue_is_empty(&rx->dec_queue));
-    assert(iqueue_is_empty(&rx->sym_queue));
-    assert(iqueue_is_empty(&rx->src_queue));
+    Listener *ls = rx->ls;
+
+    assert(iqueue_is_empty(&rx->lent_queue));
 
-    close(rx->DataSock);
-    close(rx->SignalSock);
-    kodoc_delete_factory(rx->dec_factory);
-    free(rx->pktbuf);
-    free(rx);
+    for (int i = 0; i < RXWINDOW; i++) {
+        if (rx->blocks[i] == NULL) continue;
+        PutDec(ls, rx->blocks[i]);
+        rx->dec_cnt--;
+    }
+    assert(rx->dec_cnt == 0);
+
+    iqueue_del(&rx->hnode);
+    if (!iqueue_is_empty(&rx->rnode)) iqueue_del(&rx->rnode);
+    if (!iqueue_is_empty(&rx->anode)) iqueue_del(&rx->anode);
+    iqueue_del(&rx->inode);
+
+    // the oldest tombstone makes way
+    ls->tombs[ls->ntomb % TOMBSTONES].conn = rx->conn;
+    ls->tombs[ls->ntomb % TOMBSTONES].ts = GetTS();
+    ls->ntomb++;
+
+    debug("conn %08x closed on worker %u, total %u\n", rx->conn, ls->worker, --ls->conn_cnt);
+    ObjPool_Put(&ls->ConnPool, rx);
 }
 
-void CheckPkt(Receiver *rx) {
-    size_t pktbuflen = sizeof(Packet) + rx->payload_size;
+// Whether connection 'conn' closed less than CONNIDLE ago.
+static bool Buried(Listener *ls, uint32_t conn)
+{
+    long now = GetTS();
 
-    long EntTS = GetTS();
+    for (uint32_t i = 0; i < min(ls->ntomb, (uint32_t)TOMBSTONES); i++)
+        if (ls->tombs[i].conn == conn && now - ls->tombs[i].ts < CONNIDLE) return true;
+    return false;
+}
 
-    while (GetTS() - EntTS <= 1) {
-        ssize_t nbytes = recv(rx->DataSock, rx->pktbuf, pktbuflen, 0);
-        if (nbytes < 0) break;
-        assert(nbytes == sizeof(Packet) + rx->payload_size);
-
-        // Discard the out-of-date packet & Send full-rank feedback
-        if (rx->pktbuf->id < rx->ExpectedBlockID) {
-            AckMsg ack;
-            ack.id = rx->pktbuf->id;
-            ack.rank = rx->maxsymbol;
-            send(rx->SignalSock, &ack, sizeof(ack), 0);
+// Drops the connections not heard from for CONNIDLE, whose sender went
+// away without any of its FINs getting through. One that still lends
+// messages out is left to the application for another round.
+void Listener_Reap(Listener *ls)
+{
+    long now = GetTS();
+
+    while (!iqueue_is_empty(&ls->idle_queue)) {
+        Receiver *rx = iqueue_entry(ls->idle_queue.next, Receiver, inode);
+        if (now - rx->LastHeardTS < CONNIDLE) break;
+
+        if (!iqueue_is_empty(&rx->lent_queue)) {
+            rx->LastHeardTS = now;
+            iqueue_del(&rx->inode);
+            iqueue_add_tail(&rx->inode, &ls->idle_queue);
             continue;
         }
+        debug("conn %08x idle for %ld ms\n", rx->conn, now - rx->LastHeardTS);
+        Receiver_Release(rx);
+    }
+}
 
-        ChainedPkt *cpkt = malloc(sizeof(ChainedPkt));
-        cpkt->pkt = malloc(pktbuflen);
-        memcpy(cpkt->pkt, rx->pktbuf, pktbuflen);
+// The next connection packets came in for since the last call, NULL once
+// there is none left.
+Receiver *Listener_Ready(Listener *ls)
+{
+    if (iqueue_is_empty(&ls->ready_queue)) return NULL;
 
-        // filter out-of-time packet
-        for (iqueue_head *p = rx->pkt_queue.next, *nxt; p != &rx->pkt_queue; p = nxt) {
-            nxt = p->next;
-            ChainedPkt *entry = iqueue_entry(p, ChainedPkt, qnode);
+    Receiver *rx = iqueue_entry(ls->ready_queue.next, Receiver, rnode);
+    iqueue_del_init(&rx->rnode);
+    return rx;
+}
 
-            if (entry->pkt->id >= rx->ExpectedBlockID) break;
+static DecWrapper *FindBlock(Receiver *rx, uint32_t id)
+{
+    DecWrapper *decwrapper = rx->blocks[id % RXWINDOW];
+    return decwrapper != NULL && decwrapper->id == id ? decwrapper : NULL;
+}
 
-            iqueue_del(p);
-            free(entry->pkt);
-            free(entry);
-        }
+// The block after 'decwrapper' in the stream, if it arrived already.
+static DecWrapper *NextBlock(Receiver *rx, DecWrapper *decwrapper)
+{
+    return FindBlock(rx, decwrapper->id + 1);
+}
 
-        // insert to right pos at the end
-        iqueue_head *p, *prev;
-        for (p = rx->pkt_queue.prev; p != &rx->pkt_queue; p = prev) {
-            prev = p->prev;
-            ChainedPkt *entry = iqueue_entry(p, ChainedPkt, qnode);
+// Coded packets of a block closed at nsym symbols never reference the ones
+// above, so rank nsym means all of them are decoded.
+static bool BlockDone(Receiver *rx, DecWrapper *decwrapper)
+{
+    if (rx->ls->cfg.codec == kodoc_sliding_window) return false;
+    return kodoc_rank(decwrapper->dec) == decwrapper->nsym;
+}
 
-            if (cpkt->pkt->id >= entry->pkt->id) break;
-        }
+// Block 'id' for an incoming packet, opened on its first one. NULL when its
+// slot is still taken by a block RXWINDOW older, the sender repairs later.
+static DecWrapper *OpenBlock(Receiver *rx, uint32_t id)
+{
+    Listener *ls = rx->ls;
+    DecWrapper **slot = &rx->blocks[id % RXWINDOW];
+    if (*slot != NULL) return (*slot)->id == id ? *slot : NULL;
+
+    DecWrapper *decwrapper;
+    if (iqueue_is_empty(&ls->spare_queue)) {
+        decwrapper = BuildDec(ls);
+    } else {
+        decwrapper = iqueue_entry(ls->spare_queue.next, DecWrapper, qnode);
+        iqueue_del(&decwrapper->qnode);
+        ls->spare_cnt--;
+    }
+
+    decwrapper->id = id;
+    decwrapper->nsym = ls->maxsymbol;
+    decwrapper->refs = 1;   // the read cursor's, see Borrow()
+    decwrapper->retired = false;
+    decwrapper->pkts = 0;
+    iqueue_init(&decwrapper->bnode);
+    kodoc_set_mutable_symbols(decwrapper->dec, decwrapper->pblk, ls->blksize);
+    *slot = decwrapper;
+    rx->dec_cnt++;
+    return decwrapper;
+}
 
-        cpkt->qnode.prev = p;
-        cpkt->qnode.next = p->next;
-        p->next->prev = &cpkt->qnode;
-        p->next = &cpkt->qnode;
+// Acks go out together with the others of the same receive batch, each to
+// the address its connection was last heard from.
+static void SendAcks(Listener *ls)
+{
+    for (uint32_t off = 0; off < ls->ackcnt; ) {
+        int n = ls->backend == IO_URING ?
+                Uring_SendBatch(&ls->sendring, ls->DataSock, ls->ackmsg + off, ls->ackcnt - off) :
+                sendmmsg(ls->DataSock, ls->ackmsg + off, ls->ackcnt - off, 0);
+        if (n <= 0) break;
+        off += n;
     }
+    ls->ackcnt = 0;
+}
 
+// Queues one ack for everything the connection holds: the blocks below the
+// decoded frontier, then what there is of each block above it. A GRO read
+// holds many datagrams, so a batch may ack more than IOBATCH.
+static void QueueAck(Receiver *rx)
+{
+    Listener *ls = rx->ls;
+
+    if (ls->ackcnt == IOBATCH) SendAcks(ls);
+    AckMsg *ack = (AckMsg *)(ls->ackbuf + ls->ackcnt * ACKMAXLEN);
+    ack->conn = rx->conn;
+    ack->cumid = rx->ExpectedBlockID;
+    ack->nblk = 0;
+    for (uint32_t i = 0; i < RXWINDOW; i++) {
+        DecWrapper *decwrapper = FindBlock(rx, ack->cumid + i);
+        ack->blocks[i].rank = ack->blocks[i].count = 0;
+        // packets left to DecodeBatch() are not in the rank yet, the block
+        // goes out as not heard of until they are
+        if (decwrapper == NULL || !iqueue_is_empty(&decwrapper->bnode)) continue;
+        // a flushed block reports full rank once it is done
+        ack->blocks[i].rank = BlockDone(rx, decwrapper) ? ls->maxsymbol : kodoc_rank(decwrapper->dec);
+        ack->blocks[i].count = decwrapper->pkts;
+        ack->nblk = i + 1;
+    }
+    ls->ackiov[ls->ackcnt].iov_len = sizeof(AckMsg) + ack->nblk * sizeof(AckBlock);
+    ls->ackaddr[ls->ackcnt] = rx->peer;
+    ls->ackcnt++;
+
+    rx->unacked = 0;
+    if (!iqueue_is_empty(&rx->anode)) iqueue_del_init(&rx->anode);
 }
 
-void MovPkt2Dec(Receiver *rx)
+// Accounts for a packet of the connection: acks at once when it completed
+// a block, else once cfg.ackevery packets wait or the first of them did
+// for cfg.ackdelay, see AckDue().
+static void NoteAck(Receiver *rx, bool completed)
 {
-    while (!iqueue_is_empty(&rx->pkt_queue)) {
-        IQUEUE_HEAD(sameid);
-        uint32_t id = (iqueue_entry(rx->pkt_queue.next, ChainedPkt, qnode))->pkt->id;
-        int npkts = 0;
+    Listener *ls = rx->ls;
 
-        // detach a list of packets of the same id, at least one
-        for (iqueue_head *p = rx->pkt_queue.next, *nxt; p != &rx->pkt_queue; p = nxt) {
-            nxt = p->next;
-            ChainedPkt *cpkt = iqueue_entry(p, ChainedPkt, qnode);
+    if (completed || ++rx->unacked >= ls->cfg.ackevery) {
+        QueueAck(rx);
+    } else if (iqueue_is_empty(&rx->anode)) {
+        rx->ackdue = GetTS() + ls->cfg.ackdelay;
+        iqueue_add_tail(&rx->anode, &ls->ack_queue);
+    }
+}
+
+// Queues the acks whose delay is up, the queue is in ackdue order.
+static void AckDue(Listener *ls)
+{
+    long now = GetTS();
+
+    while (!iqueue_is_empty(&ls->ack_queue)) {
+        Receiver *rx = iqueue_entry(ls->ack_queue.next, Receiver, anode);
+        if (rx->ackdue > now) break;
+        QueueAck(rx);
+    }
+}
+
+// When the next delayed ack is due, or the next connection idles out, -1
+// if there is no connection.
+long Listener_Deadline(Listener *ls)
+{
+    if (iqueue_is_empty(&ls->idle_queue)) return -1;
+
+    long deadline = iqueue_entry(ls->idle_queue.next, Receiver, inode)->LastHeardTS + CONNIDLE;
+    if (!iqueue_is_empty(&ls->ack_queue))
+        deadline = min(deadline, iqueue_entry(ls->ack_queue.next, Receiver, anode)->ackdue);
+    return deadline;
+}
+
+// Feeds a block the packets it got in the batch, on a decoder thread. The
+// blocks are independent, each is decoded by one thread at a time.
+static void DecodeBlock(void *ctx, void *task)
+{
+    Listener *ls = ctx;
+    DecWrapper *decwrapper = task;
+
+    for (uint32_t i = decwrapper->bhead; i != DECBATCH; i = ls->batch[i].next) {
+        if (BlockDone(ls->batch[i].rx, decwrapper)) break;
+        kodoc_read_payload(decwrapper->dec, ls->batch[i].pkt->data);
+    }
+}
+
+// Decodes the packets batched so far, their blocks spread across the
+// decoder threads, and accounts for their acks, a block's last packet of
+// the batch completes it. The batch reads the receive buffers, they are
+// reused only after this.
+static void DecodeBatch(Listener *ls)
+{
+    uint32_t n = 0;
+
+    while (!iqueue_is_empty(&ls->batch_queue)) {
+        DecWrapper *decwrapper = iqueue_entry(ls->batch_queue.next, DecWrapper, bnode);
+        iqueue_del_init(&decwrapper->bnode);
+        ls->tasks[n++] = decwrapper;
+    }
+    WorkPool_Run(&ls->decoders, (void **)ls->tasks, n);
+
+    for (uint32_t i = 0; i < ls->batchcnt; i++) {
+        DecItem *item = &ls->batch[i];
+        NoteAck(item->rx, i == item->dec->btail && !item->dec->wasdone &&
+                BlockDone(item->rx, item->dec));
+    }
+    ls->batchcnt = 0;
+
+    for (uint32_t i = 0; i < ls->nbid; i++)
+        Uring_Recycle(&ls->recvring, ls->batchbid[i]);
+    ls->nbid = 0;
+}
 
-            if (cpkt->pkt->id == id) {
-                iqueue_del(p);
-                iqueue_add_tail(p, &sameid);
-                npkts++;
-            } else {
-                break;
+// Leaves 'pkt' of block 'decwrapper' to the next DecodeBatch(), 'wasdone'
+// if the block was decoded before it.
+static void BatchPkt(Receiver *rx, DecWrapper *decwrapper, Packet *pkt, bool wasdone)
+{
+    Listener *ls = rx->ls;
+
+    if (ls->batchcnt == DECBATCH) DecodeBatch(ls);
+
+    uint32_t i = ls->batchcnt++;
+    ls->batch[i].rx = rx;
+    ls->batch[i].dec = decwrapper;
+    ls->batch[i].pkt = pkt;
+    ls->batch[i].next = DECBATCH;
+    if (iqueue_is_empty(&decwrapper->bnode)) {
+        iqueue_add_tail(&decwrapper->bnode, &ls->batch_queue);
+        decwrapper->bhead = i;
+        decwrapper->wasdone = wasdone;
+    } else {
+        ls->batch[decwrapper->btail].next = i;
+    }
+    decwrapper->btail = i;
+}
+
+static void HandlePkt(Listener *ls, Packet *pkt, size_t nbytes, const struct sockaddr_in *from)
+{
+    // payloads shrink with the coding header, never grow past the max. The
+    // port is open to anyone, so whatever else turns up is dropped
+    if (nbytes < sizeof(Packet) || nbytes > sizeof(Packet) + ls->payload_size) {
+        debug("malformed datagram of %zu bytes, %lu so far\n", nbytes, (unsigned long)++ls->malformed);
+        return;
+    }
+
+    // a stray packet of a connection closed already must not open it again,
+    // so only block 0 opens one, the sender repeats it until it is acked
+    Receiver *rx = FindConn(ls, pkt->conn);
+    if (rx == NULL) {
+        if (pkt->id != 0 || nbytes == sizeof(Packet) || Buried(ls, pkt->conn)) return;
+        rx = Accept(ls, pkt->conn);
+    }
+    rx->peer = *from;
+    rx->LastHeardTS = GetTS();
+    iqueue_del(&rx->inode);
+    iqueue_add_tail(&rx->inode, &ls->idle_queue);
+    if (iqueue_is_empty(&rx->rnode)) iqueue_add_tail(&rx->rnode, &ls->ready_queue);
+
+    // the sender is gone, everything it sent was decoded
+    if (nbytes == sizeof(Packet)) {
+        rx->closed = true;
+        return;
+    }
+
+    // Discard the out-of-date packet, the ack's cumulative id covers it
+    if (pkt->id < rx->ExpectedBlockID) {
+        NoteAck(rx, false);
+        return;
+    }
+
+    DecWrapper *decwrapper = OpenBlock(rx, pkt->id);
+    if (decwrapper == NULL) return;
+
+    bool wasdone = BlockDone(rx, decwrapper);
+    decwrapper->nsym = min(decwrapper->nsym, (uint32_t)pkt->nsym);
+    decwrapper->pkts++;
+
+    if (ls->cfg.decoders > 0) {
+        BatchPkt(rx, decwrapper, pkt, wasdone);
+        return;
+    }
+
+    if (!BlockDone(rx, decwrapper))
+        kodoc_read_payload(decwrapper->dec, pkt->data);
+
+    NoteAck(rx, !wasdone && BlockDone(rx, decwrapper));
+}
+
+// The size of the datagrams GRO coalesced into this read, all of them but
+// the last one, or 0 if it is a single datagram.
+static size_t GROSize(struct msghdr *hdr)
+{
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(hdr); cmsg != NULL; cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+        if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+            int size;
+            memcpy(&size, CMSG_DATA(cmsg), sizeof(size));
+            return (size_t)size;
+        }
+    }
+    return 0;
+}
+
+// Feeds every datagram to its connection's block decoder straight from the
+// receive buffer and acks it, IOBATCH reads per recvmmsg() or whatever the
+// ring's multishot receive completed, until the socket is drained or 1ms is
+// up. With decoder threads a read batch is decoded at once, see
+// DecodeBatch(). The connections that got packets are queued for
+// Listener_Ready().
+void CheckPkt(Listener *ls) {
+    long EntTS = GetTS();
+
+    if (ls->backend == IO_URING) {
+        void *pkt, *from;
+        size_t len;
+        uint16_t bid;
+        while (GetTS() - EntTS <= 1 && (pkt = Uring_NextRecv(&ls->recvring, &len, &bid, &from)) != NULL) {
+            HandlePkt(ls, pkt, len, from);
+            if (ls->cfg.decoders == 0) {
+                Uring_Recycle(&ls->recvring, bid);
+                continue;
             }
+            // the batch decodes straight from the ring's buffers
+            ls->batchbid[ls->nbid++] = bid;
+            if (ls->nbid == IOBATCH) DecodeBatch(ls);
         }
+        DecodeBatch(ls);
+        AckDue(ls);
+        SendAcks(ls);
+        return;
+    }
 
-        // find the decoder or find the right inserted positioin
-        iqueue_head *pos = NULL;
-        iqueue_foreach_entry(pos, &rx->dec_queue) {
-            DecWrapper *decwrapper = iqueue_entry(pos, DecWrapper, qnode);
-            if (id <= decwrapper->id) break;
+    while (GetTS() - EntTS <= 1) {
+        for (int i = 0; i < IOBATCH; i++) {
+            ls->rxmsg[i].msg_hdr.msg_namelen = sizeof(ls->rxaddr[i]);
+            if (!ls->gro) continue;
+            ls->rxmsg[i].msg_hdr.msg_control = ls->rxctrl[i];
+            ls->rxmsg[i].msg_hdr.msg_controllen = sizeof(ls->rxctrl[i]);
         }
 
-        DecWrapper *decwrapper = NULL;
-        if (pos == &rx->dec_queue || iqueue_entry(pos, DecWrapper, qnode)->id > id) {
-            // allocate a new one
-            decwrapper = malloc((sizeof(DecWrapper)));
-            decwrapper->id = id;
-            decwrapper->dec = kodoc_factory_build_coder(rx->dec_factory);
-            decwrapper->pblk = malloc(rx->blksize);
-            kodoc_set_mutable_symbols(decwrapper->dec, decwrapper->pblk, rx->blksize);
-            // insert into the right pos
-            decwrapper->qnode.prev = pos->prev;
-            decwrapper->qnode.next = pos;
-            pos->prev->next = &decwrapper->qnode;
-            pos->prev = &decwrapper->qnode;
-        } else {
-            decwrapper = iqueue_entry(pos, DecWrapper, qnode);
+        int n = recvmmsg(ls->DataSock, ls->rxmsg, IOBATCH, 0, NULL);
+        if (n <= 0) break;
+
+        for (int i = 0; i < n; i++) {
+            uint8_t *pkt = ls->pktbuf + i * ls->rxslot;
+            size_t len = ls->rxmsg[i].msg_len;
+            size_t seg = ls->gro ? GROSize(&ls->rxmsg[i].msg_hdr) : 0;
+            if (seg == 0) seg = len;
+
+            // GRO only coalesces datagrams of the same source
+            for (size_t off = 0; off < len; off += seg)
+                HandlePkt(ls, (Packet *)(pkt + off), min(seg, len - off), &ls->rxaddr[i]);
         }
+        DecodeBatch(ls);
+        SendAcks(ls);
+
+        if (n < IOBATCH) break;
+    }
+    AckDue(ls);
+    SendAcks(ls);
+}
+
+// Done decoding, the block stays until nothing reads it.
+static void RetireDec(Receiver *rx, DecWrapper *decwrapper)
+{
+    // a sliding window stream ends where its sender stopped
+    if (rx->ls->cfg.codec == kodoc_sliding_window) decwrapper->nsym = rx->ExpectedSymbolID;
+    rx->ExpectedSymbolID = 0;
+    rx->ExpectedBlockID++;
+    decwrapper->retired = true;
+}
 
-        assert(decwrapper != NULL && decwrapper->id == id);
+static void Unref(Receiver *rx, DecWrapper *decwrapper)
+{
+    if (--decwrapper->refs > 0) return;
 
-        // feed the pkts to the decoder
-        ChainedPkt *cpkt = NULL;
-        for (iqueue_head *p = sameid.next, *nxt; p != &sameid; p = nxt) {
-            nxt = p->next;
-            cpkt = iqueue_entry(p, ChainedPkt, qnode);
+    assert(decwrapper->retired);
+    rx->blocks[decwrapper->id % RXWINDOW] = NULL;
+    rx->dec_cnt--;
+    PutDec(rx->ls, decwrapper);
+}
 
-            if (!kodoc_is_complete(decwrapper->dec))
-                kodoc_read_payload(decwrapper->dec, cpkt->pkt->data);
+// A sliding window decoder recycles the slots below the oldest message still
+// lent out of its stream, or below the read cursor.
+static void UnpinSymbols(Receiver *rx)
+{
+    if (rx->ls->cfg.codec != kodoc_sliding_window) return;
 
-            AckMsg ack;
-            ack.id = cpkt->pkt->id;
-            ack.rank = kodoc_rank(decwrapper->dec);
-            send(rx->SignalSock, &ack, sizeof(AckMsg), 0);
+    DecWrapper *decwrapper = FindBlock(rx, rx->ExpectedBlockID);
+    if (decwrapper == NULL || rx->ReadBlockID != decwrapper->id) return;
 
-            iqueue_del(p);
-            free(cpkt->pkt);
-            free(cpkt);
+    uint32_t index = rx->ReadSymbolID;
+    LentMsg *lent = NULL;
+    iqueue_foreach(lent, &rx->lent_queue, LentMsg, qnode) {
+        if (lent->first->id + lent->nblk > decwrapper->id) {
+            index = lent->first == decwrapper ? lent->sym : 0;
+            break;
         }
     }
+    kodoc_release_symbols(decwrapper->dec, index);
 }
 
+// Moves the decoded frontier, ExpectedSymbolID of block ExpectedBlockID, as
+// far as the decoders allow, over every block that is done by now. Nothing
+// is copied, Borrow() reads the block.
 void GenSym(Receiver *rx)
 {
-    if (iqueue_is_empty(&rx->dec_queue)) return;
+    DecWrapper *decwrapper;
 
-    DecWrapper *decwrapper = iqueue_entry(rx->dec_queue.next, DecWrapper, qnode);
+    while ((decwrapper = FindBlock(rx, rx->ExpectedBlockID)) != NULL) {
+        if (rx->ls->cfg.codec == kodoc_sliding_window) {
+            while (kodoc_is_symbol_uncoded(decwrapper->dec, rx->ExpectedSymbolID)) {
+                debug("dec[%u] sym[%u] decoded\n", decwrapper->id, rx->ExpectedSymbolID);
+                rx->ExpectedSymbolID++;
+            }
 
-    if (decwrapper->id == rx->ExpectedBlockID) {
-        while (kodoc_is_symbol_uncoded(decwrapper->dec, rx->ExpectedSymbolID)) {
-            debug("dec[%u] sym[%u] decoded\n", decwrapper->id, rx->ExpectedSymbolID);
+            UnpinSymbols(rx);
 
-            Symbol *sym = malloc(sizeof(Symbol) + rx->maxsymbolsize);
-            void *src = decwrapper->pblk + rx->ExpectedSymbolID * rx->maxsymbolsize;
-            memcpy(sym->data, src, rx->maxsymbolsize);
-            iqueue_add_tail(&sym->qnode, &rx->sym_queue);
+            // the sender only opens a new stream after this one was fully acked
+            if (NextBlock(rx, decwrapper) == NULL ||
+                    rx->ExpectedSymbolID != kodoc_rank(decwrapper->dec))
+                return;
+            RetireDec(rx, decwrapper);
+            continue;
+        }
 
+        while (rx->ExpectedSymbolID < decwrapper->nsym &&
+                kodoc_is_symbol_uncoded(decwrapper->dec, rx->ExpectedSymbolID)) {
+            debug("dec[%u] sym[%u] decoded\n", decwrapper->id, rx->ExpectedSymbolID);
             rx->ExpectedSymbolID++;
-
-            if (rx->ExpectedSymbolID == rx->maxsymbol) {
-                rx->ExpectedSymbolID = 0;
-                rx->ExpectedBlockID++;
-                iqueue_del(&decwrapper->qnode);
-                kodoc_delete_coder(decwrapper->dec);
-                free(decwrapper->pblk);
-                free(decwrapper);
-                break;
-            }
         }
+
+        // a flushed block may learn its size only after its last symbol
+        if (rx->ExpectedSymbolID != decwrapper->nsym) return;
+        RetireDec(rx, decwrapper);
     }
 }
 
-void ReSym2Src(Receiver *rx)
+static uint8_t *SymAt(Receiver *rx, DecWrapper *decwrapper, uint32_t idx)
 {
-    static SrcData *psd = NULL;
-    void *psrc;
-    size_t RestSrcLen;
-    static void *pdst = NULL; // default to NULL by 'static' at startup
-    static size_t RestDstLen = 0; // default to zero at startup
+    return decwrapper->pblk + (idx % rx->ls->maxsymbol) * rx->ls->maxsymbolsize;
+}
 
-    while (!iqueue_is_empty(&rx->sym_queue)) {
-        Symbol *psym = iqueue_entry(rx->sym_queue.next, Symbol, qnode);
-        psrc = psym->data;
-        RestSrcLen = rx->maxsymbolsize;
+// Decoded bytes from offset 'off' of symbol 'idx' on that are contiguous in
+// the block, a sliding window wraps at its last slot.
+static size_t Span(Receiver *rx, DecWrapper *decwrapper, uint32_t idx, uint32_t off)
+{
+    uint32_t limit;
+    if (decwrapper->retired) limit = decwrapper->nsym;
+    else if (decwrapper->id == rx->ExpectedBlockID) limit = rx->ExpectedSymbolID;
+    else return 0;
+
+    if (rx->ls->cfg.codec == kodoc_sliding_window)
+        limit = min(limit, idx - idx % rx->ls->maxsymbol + rx->ls->maxsymbol);
+    if (limit <= idx) return 0;
+    return (size_t)(limit - idx) * rx->ls->maxsymbolsize - off;
+}
 
-        while (RestSrcLen >= 2) {
-            if (pdst == NULL) {
-                RestDstLen = *((uint16_t *)psrc);
-                assert(RestDstLen == INTENDEDLEN || RestDstLen == 0);
-                if (RestDstLen == 0) break;
-                else {
-                    psd = malloc(sizeof(SrcData) + RestDstLen - sizeof(uint16_t));
-                    pdst = psd->data;
-                    memset(pdst, 0, RestDstLen);
-                }
-            }
+// Lends the next message to the application as 'iovmax' segments at most,
+// pointing into the decoded blocks. A message comes in one piece unless it
+// straddles two blocks or the wrap of the sliding window. Returns the number
+// of segments, 0 until a whole message is decoded. The blocks are held
+// until the message is handed back with Release(), in the order lent.
+int Borrow(Receiver *rx, struct iovec *iov, int iovmax)
+{
+    const uint32_t size = rx->ls->maxsymbolsize;
+    DecWrapper *decwrapper;
+
+    while ((decwrapper = FindBlock(rx, rx->ReadBlockID)) != NULL) {
+        if (Span(rx, decwrapper, rx->ReadSymbolID, rx->ReadOffset) == 0) {
+            if (!decwrapper->retired) return 0;
+            // read to the end of a decoded block
+            rx->ReadBlockID++;
+            rx->ReadSymbolID = rx->ReadOffset = 0;
+            Unref(rx, decwrapper);
+            continue;
+        }
+
+        uint8_t *p = SymAt(rx, decwrapper, rx->ReadSymbolID) + rx->ReadOffset;
+        uint16_t Len = 0;
+        if (size - rx->ReadOffset >= sizeof(Len)) memcpy(&Len, p, sizeof(Len));
 
-            debug("RestSrcLen: %zu, RestDstLen: %zu, MaxCopyable: %lu\n",
-                   RestSrcLen, RestDstLen, min(RestDstLen, RestSrcLen));
-            size_t MaxCopyable = min(RestSrcLen, RestDstLen);
-            memcpy(pdst, psrc, MaxCopyable);
-            pdst += MaxCopyable; psrc += MaxCopyable;
-            RestDstLen -= MaxCopyable; RestSrcLen -= MaxCopyable;
-
-
-            if (RestDstLen == 0) {
-                assert(psd->Len == INTENDEDLEN);
-                debug("Add src, cnt: %u, seq: %u, len: %hu\n", ++rx->src_cnt,
-                       *(uint32_t *)(psd->rawdata), psd->Len);
-                iqueue_add_tail(&psd->qnode, &rx->src_queue);
-                psd = pdst = NULL;
-                RestDstLen = 0;
+        // the rest of the symbol is padding
+        if (Len == 0) {
+            rx->ReadSymbolID++;
+            rx->ReadOffset = 0;
+            continue;
+        }
+        assert(Len >= sizeof(Len));
+
+        // the message may only be lent once all of it is decoded
+        DecWrapper *last = decwrapper;
+        uint32_t idx = rx->ReadSymbolID + (rx->ReadOffset + sizeof(Len)) / size;
+        uint32_t off = (rx->ReadOffset + sizeof(Len)) % size;
+        size_t RestLen = Len - sizeof(Len);
+        uint32_t nblk = 1;
+        int n = 0;
+
+        iov[0].iov_base = p + sizeof(Len);
+        iov[0].iov_len = 0;
+
+        while (RestLen > 0) {
+            size_t span = Span(rx, last, idx, off);
+            if (span == 0) {
+                if (!last->retired || (last = NextBlock(rx, last)) == NULL) return 0;
+                idx = off = 0;
+                nblk++;
+                continue;
             }
+
+            assert(n < iovmax);
+            size_t MaxLendable = min(RestLen, span);
+            iov[n].iov_base = SymAt(rx, last, idx) + off;
+            iov[n].iov_len = MaxLendable;
+            n++;
+
+            RestLen -= MaxLendable;
+            idx += (off + MaxLendable) / size;
+            off = (off + MaxLendable) % size;
         }
 
-        iqueue_del(&psym->qnode);
-        free(psym);
+        // the message holds every block it spans, the cursor hands over
+        // the ones it leaves
+        LentMsg *lent = ObjPool_Get(&rx->ls->LentPool);
+        lent->first = decwrapper;
+        lent->nblk = nblk;
+        lent->sym = rx->ReadSymbolID;
+        iqueue_add_tail(&lent->qnode, &rx->lent_queue);
+
+        last->refs++;
+
+        rx->ReadBlockID = last->id;
+        rx->ReadSymbolID = idx;
+        rx->ReadOffset = off;
+
+        return max(n, 1);
     }
+
+    return 0;
 }
 
+// Hands back the oldest message lent by Borrow().
+void Release(Receiver *rx)
+{
+    assert(!iqueue_is_empty(&rx->lent_queue));
+
+    LentMsg *lent = iqueue_entry(rx->lent_queue.next, LentMsg, qnode);
+    iqueue_del(&lent->qnode);
+
+    DecWrapper *decwrapper = lent->first;
+    for (uint32_t i = 0; i < lent->nblk; i++) {
+        DecWrapper *next = i + 1 < lent->nblk ? NextBlock(rx, decwrapper) : NULL;
+        Unref(rx, decwrapper);
+        decwrapper = next;
+    }
+    ObjPool_Put(&rx->ls->LentPool, lent);
+
+    UnpinSymbols(rx);
+}
+
+// Copies the next message out, as Borrow() and Release() in one go.
 int Recv(Receiver *rx, void *buf, size_t buflen)
 {
-    if (iqueue_is_empty(&rx->src_queue)) return 0;
+    struct iovec iov[MAXIOV];
+    int n = Borrow(rx, iov, MAXIOV);
+    if (n == 0) return 0;
+
+    size_t len = 0;
+    for (int i = 0; i < n; i++) {
+        assert(len + iov[i].iov_len <= buflen);
+        memcpy(buf + len, iov[i].iov_base, iov[i].iov_len);
+        len += iov[i].iov_len;
+    }
+    Release(rx);
+
+    return (int)len;
+}
 
-    SrcData *psd = iqueue_entry(rx->src_queue.next, SrcData, qnode);
-    assert(psd->Len >= sizeof(psd->Len));
-    assert(buflen == psd->Len - sizeof(psd->Len));
-    debug("Del src: %u\n", --rx->src_cnt);
-    memcpy(buf, psd->rawdata, psd->Len - sizeof(psd->Len)); // copy rawdata
-    iqueue_del(&psd->qnode);
-    free(psd);
+typedef struct {
+    const LRTConfig *cfg;
+    uint32_t index;
+    sem_t *bound;           // posted once its socket is in the group
+} WorkerArg;
 
-    return (int)buflen;
+// The CPU of worker 'index', round robin over the ones we may run on.
+static int WorkerCPU(uint32_t index)
+{
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) return -1;
+
+    uint32_t n = index % (uint32_t)CPU_COUNT(&set);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        if (CPU_ISSET(cpu, &set) && n-- == 0) return cpu;
+    return -1;
 }
 
-int main()
+// One event loop with its own socket, pools and connections, sharing
+// nothing with the other workers.
+static void *Worker(void *arg)
 {
-    Receiver *rx = Receiver_Init(MAXSYMBOL, MAXSYMBOLSIZE);
+    WorkerArg *wa = arg;
+
+    // pinned before anything is allocated, the arena follows the core
+    int cpu = WorkerCPU(wa->index);
+    if (wa->cfg->workers > 1 && cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
 
-    uint32_t seq = 0;
+    Listener *ls = Listener_Init(wa->cfg, wa->index);
+    sem_post(wa->bound);
 
+    Receiver *rx;
+
+    struct iovec iov[MAXIOV];
     UserData_t ud;
+    int n;
+
+    while (true) {
+        CheckPkt(ls);
+
+        while ((rx = Listener_Ready(ls)) != NULL) {
+            GenSym(rx);
+
+            // read in place, only a message straddling blocks is gathered
+            while ((n = Borrow(rx, iov, MAXIOV)) > 0) {
+                UserData_t *pud = iov[0].iov_base;
+                size_t len = iov[0].iov_len;
+                if (n > 1) {
+                    len = 0;
+                    for (int i = 0; i < n; i++) {
+                        assert(len + iov[i].iov_len <= sizeof(ud));
+                        memcpy((uint8_t *)&ud + len, iov[i].iov_base, iov[i].iov_len);
+                        len += iov[i].iov_len;
+                    }
+                    pud = &ud;
+                }
+                assert(len == sizeof(ud));
 
-    do {
-        CheckPkt(rx);
-        MovPkt2Dec(rx);
-        GenSym(rx);
-        ReSym2Src(rx);
+                printf("[%u]Delay: %ld\n", pud->seq, GetTS() - pud->ts);
 
-        while (Recv(rx, &ud, sizeof(ud)) > 0) {
-            printf("[%u]Delay: %ld\n", ud.seq, GetTS() - ud.ts);
+                int i;
+                for (i = 0; i < PADLEN && pud->buf[i] == ('a' + (pud->seq * 3 / 2) % 26); i++);
+                assert(i == PADLEN);
 
-            int i;
-            for (i = 0; i < PADLEN && ud.buf[i] == ('a' + (ud.seq * 3 / 2) % 26); i++);
-            assert(i == PADLEN);
+                Release(rx);
+            }
+
+            // a sender closes once all of it was acked, so all of it was read
+            if (rx->closed) Receiver_Release(rx);
         }
-    } while (seq < LOOPCNT ||
-            !iqueue_is_empty(&rx->pkt_queue) ||
-            !iqueue_is_empty(&rx->dec_queue) ||
-            !iqueue_is_empty(&rx->sym_queue) ||
-            !iqueue_is_empty(&rx->src_queue));
-
-    Receiver_Release(rx);
-}
\ No newline at end of file
+        Listener_Reap(ls);
+
+        // sleep until data comes in, a delayed ack or an idle timeout is due
+        Reactor_Wait(&ls->reactor, Listener_Deadline(ls));
+    }
+
+    return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+    LRTConfig cfg;
+    LRTConfig_Default(&cfg);
+    LRTConfig_Parse(&cfg, argc, argv);
+
+    static WorkerArg args[MAXWORKERS];
+    static pthread_t threads[MAXWORKERS];
+    sem_t bound;
+    sem_init(&bound, 0, 0);
+
+    // one at a time, the group numbers its sockets in the order they bind
+    for (uint32_t i = 0; i < cfg.workers; i++) {
+        args[i].cfg = &cfg;
+        args[i].index = i;
+        args[i].bound = &bound;
+        int rval = pthread_create(&threads[i], NULL, Worker, &args[i]);
+        assert(rval == 0);
+        sem_wait(&bound);
+    }
+
+    for (uint32_t i = 0; i < cfg.workers; i++)
+        pthread_join(threads[i], NULL);
+}
@@ -1,10 +1,11 @@
 //
 // Created by Sai Jiang on 17/10/22.
 //
+#include <math.h>
+#include <sys/eventfd.h>
+#include <sys/random.h>
 #include "common.h"
 
-static const int32_t codec = kodoc_on_the_fly;
-
 void TokenBucketInit(TokenBucket *tb, double rate)
 {
     tb->ts = GetTS();
@@ -42,246 +43,851 @@ bool GetToken(TokenBucket *tb, size_t need)
     return rval;
 }
 
-Transmitter *Transmitter_Init(uint32_t maxsymbols, uint32_t maxsymbolsize)
+// The GetTS() time at which GetToken(tb, need) succeeds at the earliest.
+long TokenDeadline(TokenBucket *tb, size_t need)
+{
+    PutToken(tb);
+    if (tb->CurCapactiy >= need) return GetTS();
+    return tb->ts + (long)((need - tb->CurCapactiy) / tb->LimitedRate) + 1;
+}
+
+static EncWrapper *BuildEnc(Transmitter *tx)
+{
+    EncWrapper *encwrapper = ObjPool_Get(&tx->EncPool);
+    encwrapper->enc = kodoc_factory_build_coder(tx->enc_factory);
+    encwrapper->pblk = Arena_Get(&tx->BlkArena);
+    encwrapper->rpbuf = malloc(REPAIRBURST * (sizeof(Packet) + tx->payload_size));
+    assert(encwrapper->pblk != NULL && encwrapper->rpbuf != NULL);
+    return encwrapper;
+}
+
+static void *EncodeBursts(void *arg);
+
+// Starts the encoder threads, blocks get one by id.
+static void StartEncoders(Transmitter *tx)
+{
+    tx->nencoder = tx->cfg.encoders;
+    tx->encoders = NULL;
+    tx->burstfd = -1;
+    if (tx->nencoder == 0) return;
+
+    tx->burstfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    assert(tx->burstfd >= 0);
+    Reactor_Add(&tx->reactor, tx->burstfd);
+
+    tx->encoders = calloc(tx->nencoder, sizeof(EncThread));
+    assert(tx->encoders != NULL);
+    for (uint32_t i = 0; i < tx->nencoder; i++) {
+        EncThread *et = &tx->encoders[i];
+        et->tx = tx;
+        et->stop = false;
+        ispsc_init(&et->jobs, et->jobslots, TXWINDOW);
+        ispsc_init(&et->done, et->doneslots, TXWINDOW);
+        sem_init(&et->wake, 0, 0);
+        int rval = pthread_create(&et->thread, NULL, EncodeBursts, et);
+        assert(rval == 0);
+    }
+    debug("%u encoder threads\n", tx->nencoder);
+}
+
+static void StopEncoders(Transmitter *tx)
+{
+    for (uint32_t i = 0; i < tx->nencoder; i++) {
+        EncThread *et = &tx->encoders[i];
+        __atomic_store_n(&et->stop, true, __ATOMIC_RELEASE);
+        sem_post(&et->wake);
+        pthread_join(et->thread, NULL);
+        sem_destroy(&et->wake);
+    }
+    free(tx->encoders);
+    if (tx->burstfd >= 0) close(tx->burstfd);
+}
+
+static void FreeEnc(Transmitter *tx, EncWrapper *encwrapper)
+{
+    Arena_Put(&tx->BlkArena, encwrapper->pblk);
+    free(encwrapper->rpbuf);
+    kodoc_delete_coder(encwrapper->enc);
+    ObjPool_Put(&tx->EncPool, encwrapper);
+}
+
+// Retired blocks keep their coder and buffers, up to cfg.spare of them, so
+// that a new block neither builds a coder nor faults in fresh pages.
+static void PutEnc(Transmitter *tx, EncWrapper *encwrapper)
 {
-    assert(maxsymbolsize >= 512);
+    if (tx->spare_cnt < tx->cfg.spare) {
+        kodoc_reset_coder(encwrapper->enc);
+        iqueue_add(&encwrapper->qnode, &tx->spare_queue);
+        tx->spare_cnt++;
+        return;
+    }
+
+    FreeEnc(tx, encwrapper);
+}
+
+Transmitter *Transmitter_Init(const LRTConfig *cfg)
+{
+    assert(cfg->maxsymbolsize >= MINSYMBOLSIZE);
 
     Transmitter *tx = malloc(sizeof(Transmitter));
     assert(tx != NULL);
 
-    iqueue_init(&tx->src_queue);
-
-    iqueue_init(&tx->sym_queue);
+    tx->cfg = *cfg;
 
-    iqueue_init(&tx->enc_queue);
+    memset(tx->blocks, 0, sizeof(tx->blocks));
 
     tx->enc_cnt = 0;
 
     tx->enc_factory = kodoc_new_encoder_factory(
-            codec, kodoc_binary8, maxsymbols, maxsymbolsize);
+            cfg->codec, cfg->field, cfg->maxsymbol, cfg->maxsymbolsize);
+    assert(tx->enc_factory != NULL);
 
-    tx->maxsymbol = maxsymbols;
-    tx->maxsymbolsize = maxsymbolsize;
+    tx->maxsymbol = cfg->maxsymbol;
+    tx->maxsymbolsize = cfg->maxsymbolsize;
     tx->blksize = tx->maxsymbol * tx->maxsymbolsize;
 
     tx->NextBlockID = 0;
+    tx->OldestBlockID = 0;
+
+    tx->loss = 0;
+
+    tx->LastPushTS = GetTS();
+
+    ObjPool_Init(&tx->EncPool, sizeof(EncWrapper));
+    Arena_Init(&tx->BlkArena, tx->blksize, Arena_LocalNode());
+
+    tx->woff = 0;
+    tx->reserved = NULL;
+    tx->bounce = malloc(UINT16_MAX);
+    assert(tx->bounce != NULL);
 
     tx->payload_size = kodoc_factory_max_payload_size(tx->enc_factory);
-    tx->pktbuf = malloc(sizeof(Packet) + tx->payload_size);
-    assert(tx->payload_size < 1500);
+    tx->pktbuf = malloc(IOBATCH * (sizeof(Packet) + tx->payload_size));
+    assert(tx->pktbuf != NULL && tx->payload_size < 1500);
+
+    memset(tx->txmsg, 0, sizeof(tx->txmsg));
+    tx->txcnt = 0;
+
+    iqueue_init(&tx->spare_queue);
+    tx->spare_cnt = 0;
+    while (tx->spare_cnt < tx->cfg.spare) {
+        EncWrapper *encwrapper = BuildEnc(tx);
+        memset(encwrapper->pblk, 0, tx->blksize);
+        memset(encwrapper->rpbuf, 0, REPAIRBURST * (sizeof(Packet) + tx->payload_size));
+        PutEnc(tx, encwrapper);
+    }
 
     struct sockaddr_in addr;
 
-    tx->DataSock = socket(PF_INET, SOCK_DGRAM, 0);
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    inet_pton(PF_INET, DST_IP, &addr.sin_addr);
-    addr.sin_port = htons(DST_DPORT);
-    connect(tx->DataSock, (struct sockaddr *) &addr, sizeof(addr));
+    // the receiver tells its connections apart by this id alone
+    if (getrandom(&tx->conn, sizeof(tx->conn), 0) != sizeof(tx->conn))
+        tx->conn = (uint32_t)(getpid() ^ GetTS());
 
-    tx->SignalSock = socket(PF_INET, SOCK_DGRAM, 0);
+    // the acks come back to the port we send from
+    tx->DataSock = socket(PF_INET, SOCK_DGRAM, 0);
     memset(&addr, 0, sizeof(addr));
     addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    addr.sin_port = htons(SRC_SPORT);
-    int rval = bind(tx->SignalSock, (struct sockaddr *)&addr, sizeof(struct sockaddr));
+    int rval = inet_pton(PF_INET, cfg->host != NULL ? cfg->host : DST_IP, &addr.sin_addr);
+    assert(rval == 1);
+    addr.sin_port = htons(cfg->port);
+    rval = connect(tx->DataSock, (struct sockaddr *) &addr, sizeof(addr));
     assert(rval >= 0);
-    int flags = fcntl(tx->SignalSock, F_GETFL, 0);
-    fcntl(tx->SignalSock, F_SETFL, flags | O_NONBLOCK);
+    debug("conn %08x\n", tx->conn);
+
+    // the kernel knows UDP_SEGMENT if it takes it as a socket option
+    int zero = 0;
+    tx->gso = cfg->offload && setsockopt(tx->DataSock, SOL_UDP, UDP_SEGMENT, &zero, sizeof(zero)) == 0;
+    debug("GSO %s\n", tx->gso ? "on" : "off");
+
+    tx->backend = cfg->backend;
+    tx->sendring.fd = tx->recvring.fd = -1;
+    if (tx->backend == IO_URING &&
+            !(Uring_Init(&tx->sendring, IOBATCH) && Uring_Init(&tx->recvring, URINGBUFS) &&
+              Uring_RecvMultishot(&tx->recvring, tx->DataSock, URINGBUFS, ACKMAXLEN, 0))) {
+        debug("%s\n", "io_uring not available, using epoll");
+        Uring_Release(&tx->sendring);
+        Uring_Release(&tx->recvring);
+        tx->backend = IO_EPOLL;
+    }
+
+    // with io_uring the acks show up on the ring rather than the socket
+    Reactor_Init(&tx->reactor, cfg->busypoll);
+    Reactor_Add(&tx->reactor, tx->backend == IO_URING ? tx->recvring.fd : tx->DataSock);
+
+    StartEncoders(tx);
 
     return tx;
 }
 
 void Transmitter_Release(Transmitter *tx)
 {
-    assert(iqueue_is_empty(&tx->src_queue));
-    assert(iqueue_is_empty(&tx->sym_queue));
-    assert(iqueue_is_empty(&tx->enc_queue));
+    assert(tx->OldestBlockID == tx->NextBlockID);
+
+    // everything was acked, the receiver may let go of the connection
+    Packet fin = { .conn = tx->conn, .id = tx->NextBlockID, .nsym = 0 };
+    for (int i = 0; i < CLOSECNT; i++)
+        send(tx->DataSock, &fin, sizeof(fin), 0);
+
+    StopEncoders(tx);
 
     kodoc_delete_factory(tx->enc_factory);
 
     free(tx->pktbuf);
 
+    free(tx->bounce);
+
+    while (!iqueue_is_empty(&tx->spare_queue)) {
+        EncWrapper *encwrapper = iqueue_entry(tx->spare_queue.next, EncWrapper, qnode);
+        iqueue_del(&encwrapper->qnode);
+        FreeEnc(tx, encwrapper);
+    }
+
+    ObjPool_Release(&tx->EncPool);
+    Arena_Release(&tx->BlkArena);
+
+    Reactor_Release(&tx->reactor);
+    Uring_Release(&tx->sendring);
+    Uring_Release(&tx->recvring);
     close(tx->DataSock);
-    close(tx->SignalSock);
 
     free(tx);
 }
 
-size_t Send(Transmitter *tx, void *buf, size_t buflen)
+static bool IsSparse(Transmitter *tx)
 {
-    SrcData *inserted = malloc(sizeof(SrcData) + buflen);
-    inserted->Len = sizeof(inserted->Len) + buflen;
-    memcpy(inserted->rawdata, buf, buflen);
-    iqueue_add_tail(&inserted->qnode, &tx->src_queue);
+    return tx->cfg.codec == kodoc_sparse_full_vector || tx->cfg.codec == kodoc_sparse_seed;
+}
 
-    return buflen;
+// A repair helps only if it touches a source symbol the receiver still
+// misses, and enough of them to keep the repairs linearly independent: about
+// ln(m) + 4 of the m missing ones. So repairs are sparse while the receiver
+// lacks a lot and become dense as it nears full rank. Repairs sent since the
+// last rank update count as delivered at the estimated loss rate.
+static double EstMissing(Transmitter *tx, EncWrapper *encwrapper)
+{
+    return (encwrapper->lrank - encwrapper->rrank) - encwrapper->repairs * (1.0 - tx->loss);
 }
 
-void Div2Sym(Transmitter *tx)
+static double RepairDensity(Transmitter *tx, EncWrapper *encwrapper)
 {
-    Symbol *psym;
-    void *psrc, *pdst;
-    size_t RestSrcLen, RestDstLen;
+    double missing = EstMissing(tx, encwrapper);
+    if (missing <= 1.0) return 1.0;
+    return min(1.0, (log(missing) + 4.0) / missing);
+}
 
-    psym = pdst = NULL;
-    RestDstLen = 0;
+// Sends every queued packet, as few sendmmsg() calls as it takes. With GSO
+// a run of equal sized packets goes out as one message the kernel splits,
+// only the last of a run may be shorter.
+void SendQueued(Transmitter *tx)
+{
+    uint32_t nmsg = 0;
+
+    for (uint32_t i = 0, j; i < tx->txcnt; i = j, nmsg++) {
+        struct msghdr *hdr = &tx->txmsg[nmsg].msg_hdr;
+        size_t seg = tx->txiov[i].iov_len;
+
+        for (j = i + 1; tx->gso && j < tx->txcnt &&
+                tx->txiov[j - 1].iov_len == seg && tx->txiov[j].iov_len <= seg; j++) ;
+
+        hdr->msg_iov = &tx->txiov[i];
+        hdr->msg_iovlen = j - i;
+        hdr->msg_control = NULL;
+        hdr->msg_controllen = 0;
+        if (j - i > 1) {
+            hdr->msg_control = tx->txctrl[nmsg];
+            hdr->msg_controllen = sizeof(tx->txctrl[nmsg]);
+            struct cmsghdr *cmsg = CMSG_FIRSTHDR(hdr);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t gso_size = (uint16_t)seg;
+            memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+        }
+    }
 
-    while (!iqueue_is_empty(&tx->src_queue)) {
-        SrcData *psd = iqueue_entry(tx->src_queue.next, SrcData, qnode);
-        psrc = psd->data;
-        RestSrcLen = psd->Len;
+    for (uint32_t off = 0; off < nmsg; ) {
+        int n = tx->backend == IO_URING ?
+                Uring_SendBatch(&tx->sendring, tx->DataSock, tx->txmsg + off, nmsg - off) :
+                sendmmsg(tx->DataSock, tx->txmsg + off, nmsg - off, 0);
+        // what does not go out is lost like any other packet, a device that
+        // can not segment makes us stop trying
+        if (n <= 0) {
+            if (tx->gso && errno == EIO) tx->gso = false;
+            break;
+        }
+        off += n;
+    }
+    tx->txcnt = 0;
+}
 
-        while (RestSrcLen > 0) {
-            if (pdst == NULL) {
-                psym = malloc(sizeof(Symbol) + tx->maxsymbolsize);
-                pdst = psym->data;
-                RestDstLen = tx->maxsymbolsize;
-                memset(pdst, 0, RestDstLen);
-            }
+// Queues 'len' bytes at 'pkt', which must stay untouched until they are
+// sent. The queue goes out once IOBATCH packets are in it, and at the end of
+// every pass of the main loop.
+static void QueuePkt(Transmitter *tx, void *pkt, size_t len)
+{
+    tx->txiov[tx->txcnt].iov_base = pkt;
+    tx->txiov[tx->txcnt].iov_len = len;
+    if (++tx->txcnt == IOBATCH) SendQueued(tx);
+}
 
-            size_t MaxCopyable = min(RestSrcLen, RestDstLen);
-            memcpy(pdst, psrc, MaxCopyable);
-            pdst += MaxCopyable; psrc += MaxCopyable;
-            RestDstLen -= MaxCopyable; RestSrcLen -= MaxCopyable;
+// Writes the next payload of 'encwrapper' into the queue.
+static void EncodePkt(Transmitter *tx, EncWrapper *encwrapper)
+{
+    Packet *pkt = (Packet *)(tx->pktbuf + tx->txcnt * (sizeof(Packet) + tx->payload_size));
 
-            if (RestDstLen == 0 || RestDstLen == 1) {
-                iqueue_add_tail(&psym->qnode, &tx->sym_queue);
-                psym = pdst = NULL;
-                RestDstLen = 0;
-            }
+    if (IsSparse(tx) && tx->cfg.density == 0)
+        kodoc_set_density(encwrapper->enc, RepairDensity(tx, encwrapper));
+
+    pkt->conn = tx->conn;
+    pkt->id = encwrapper->id;
+    pkt->nsym = (uint16_t)encwrapper->nsym;
+    encwrapper->sent++;
+    QueuePkt(tx, pkt, sizeof(Packet) + kodoc_write_payload(encwrapper->enc, pkt->data));
+}
+
+// Sizes the next burst of 'encwrapper' to what the receiver still misses,
+// and makes rpbuf free to encode it into.
+static void PlanBurst(Transmitter *tx, EncWrapper *encwrapper)
+{
+    encwrapper->rpburst = (uint32_t)max(1.0, min((double)REPAIRBURST, ceil(EstMissing(tx, encwrapper))));
+    encwrapper->rpdensity = RepairDensity(tx, encwrapper);
+    encwrapper->rplrank = encwrapper->lrank;
+    encwrapper->rplower = kodoc_window_lower(encwrapper->enc);
+
+    // queued repairs of the last burst may point into rpbuf
+    SendQueued(tx);
+}
+
+// Encodes the planned burst into rpbuf, in one pass over the block. Runs on
+// an encoder thread too, so it reads nothing of 'tx' that changes.
+static void EncodeBurst(Transmitter *tx, EncWrapper *encwrapper)
+{
+    const size_t pktlen = sizeof(Packet) + tx->payload_size;
+    uint8_t *payloads[REPAIRBURST];
+
+    if (IsSparse(tx) && tx->cfg.density == 0)
+        kodoc_set_density(encwrapper->enc, encwrapper->rpdensity);
+
+    for (uint32_t i = 0; i < encwrapper->rpburst; i++) {
+        Packet *pkt = (Packet *)(encwrapper->rpbuf + i * pktlen);
+        pkt->conn = tx->conn;
+        pkt->id = encwrapper->id;
+        payloads[i] = pkt->data;
+    }
+    kodoc_write_payloads(encwrapper->enc, payloads, encwrapper->rplen, encwrapper->rpburst);
+}
+
+static void *EncodeBursts(void *arg)
+{
+    EncThread *et = arg;
+    EncWrapper *encwrapper;
+
+    while (true) {
+        sem_wait(&et->wake);
+        while ((encwrapper = ispsc_pop(&et->jobs)) != NULL) {
+            EncodeBurst(et->tx, encwrapper);
+            bool pushed = ispsc_push(&et->done, encwrapper);
+            assert(pushed);
+            uint64_t one = 1;
+            ssize_t n = write(et->tx->burstfd, &one, sizeof(one));
+            assert(n == sizeof(one));
         }
+        if (__atomic_load_n(&et->stop, __ATOMIC_ACQUIRE)) return NULL;
+    }
+}
 
-        iqueue_del(&psd->qnode);
-        free(psd);
+// Takes back the blocks whose bursts the encoder threads are done with.
+static void CollectBursts(Transmitter *tx)
+{
+    EncWrapper *encwrapper;
+    uint64_t cnt;
+
+    if (tx->nencoder == 0) return;
+    // nothing to read unless a burst finished since the last call
+    ssize_t n = read(tx->burstfd, &cnt, sizeof(cnt));
+    assert(n == sizeof(cnt) || (n < 0 && errno == EAGAIN));
+
+    for (uint32_t i = 0; i < tx->nencoder; i++) {
+        while ((encwrapper = ispsc_pop(&tx->encoders[i].done)) != NULL) {
+            encwrapper->rphead = 0;
+            encwrapper->rpcnt = encwrapper->rpburst;
+            encwrapper->encoding = false;
+        }
     }
+}
 
-    if (psym != NULL) {
-        iqueue_add_tail(&psym->qnode, &tx->sym_queue);
-        psym = pdst = NULL;
-        RestDstLen = 0;
+// Whether NextRepair() has a repair of 'encwrapper' at hand. A closed block
+// no longer changes, with encoder threads its next burst is encoded on one
+// of them, and the block waits for it meanwhile.
+static bool RepairAtHand(Transmitter *tx, EncWrapper *encwrapper)
+{
+    if (tx->nencoder == 0 || encwrapper->rpcnt > 0 ||
+            tx->cfg.codec == kodoc_sliding_window || encwrapper->lrank < encwrapper->nsym)
+        return true;
+
+    if (!encwrapper->encoding) {
+        PlanBurst(tx, encwrapper);
+        encwrapper->encoding = true;
+        EncThread *et = &tx->encoders[encwrapper->id % tx->nencoder];
+        // a block has one burst in flight at most, TXWINDOW fit
+        bool pushed = ispsc_push(&et->jobs, encwrapper);
+        assert(pushed);
+        sem_post(&et->wake);
     }
+    return false;
 }
 
-void MovSym2Enc(Transmitter *tx)
+// Repairs are encoded up to REPAIRBURST at a time, one pass over the block
+// for the whole burst, then paced out one per token. A burst is dropped once
+// the encoder gained symbols or its window slid.
+static Packet *NextRepair(Transmitter *tx, EncWrapper *encwrapper, size_t *len)
 {
-    while (!iqueue_is_empty(&tx->sym_queue)) {
-        EncWrapper *encwrapper = NULL;
+    const size_t pktlen = sizeof(Packet) + tx->payload_size;
+    uint32_t lower = kodoc_window_lower(encwrapper->enc);
+
+    if (encwrapper->rpcnt == 0 || encwrapper->rplrank != encwrapper->lrank ||
+            encwrapper->rplower != lower) {
+        PlanBurst(tx, encwrapper);
+        EncodeBurst(tx, encwrapper);
+        encwrapper->rphead = 0;
+        encwrapper->rpcnt = encwrapper->rpburst;
+    }
+
+    uint32_t i = encwrapper->rphead++;
+    Packet *pkt = (Packet *)(encwrapper->rpbuf + i * pktlen);
+    // the block may have been closed since the burst was encoded
+    pkt->nsym = (uint16_t)encwrapper->nsym;
+    encwrapper->rpcnt--;
+    encwrapper->sent++;
+    *len = sizeof(Packet) + encwrapper->rplen[i];
+    return pkt;
+}
+
+// A block takes nsym symbols in total, a sliding window maxsymbol symbols
+// that the receiver has not acknowledged yet.
+static bool HasFreeSlot(Transmitter *tx, EncWrapper *encwrapper)
+{
+    if (tx->cfg.codec == kodoc_sliding_window)
+        return encwrapper->lrank - kodoc_window_lower(encwrapper->enc) < tx->maxsymbol;
+    return encwrapper->lrank < encwrapper->nsym;
+}
 
-        if (iqueue_is_empty(&tx->enc_queue) ||
-                iqueue_entry(tx->enc_queue.prev, EncWrapper, qnode)->lrank == tx->maxsymbol) {
-            encwrapper = malloc(sizeof(EncWrapper));
-            encwrapper->enc = kodoc_factory_build_coder(tx->enc_factory);
-            encwrapper->lrank = encwrapper->rrank = 0;
-            encwrapper->id = tx->NextBlockID++;
-            encwrapper->pblk = malloc(tx->blksize);
-            TokenBucketInit(&encwrapper->tb, 1500); // 5ms Gap
-            iqueue_add_tail(&encwrapper->qnode, &tx->enc_queue);
-            debug("enc[%u] init, total %u\n", encwrapper->id, ++tx->enc_cnt);
-        } else {
-            encwrapper = iqueue_entry(tx->enc_queue.prev, EncWrapper, qnode);
+// Where symbol 'idx' of the block lives, a sliding window wraps around it.
+static uint8_t *SymAt(Transmitter *tx, EncWrapper *encwrapper, uint32_t idx)
+{
+    return encwrapper->pblk + (idx % tx->maxsymbol) * tx->maxsymbolsize;
+}
+
+static EncWrapper *NewEnc(Transmitter *tx)
+{
+    EncWrapper *encwrapper;
+    if (iqueue_is_empty(&tx->spare_queue)) {
+        encwrapper = BuildEnc(tx);
+    } else {
+        encwrapper = iqueue_entry(tx->spare_queue.next, EncWrapper, qnode);
+        iqueue_del(&encwrapper->qnode);
+        tx->spare_cnt--;
+    }
+
+    // source symbols go out uncoded once, Fountain() only sends repairs
+    if (tx->cfg.systematic) kodoc_set_systematic_on(encwrapper->enc);
+    if (IsSparse(tx) && tx->cfg.density > 0)
+        kodoc_set_density(encwrapper->enc, tx->cfg.density);
+    encwrapper->lrank = encwrapper->rrank = 0;
+    encwrapper->nsym = tx->maxsymbol;
+    encwrapper->sent = encwrapper->acked = encwrapper->repairs = 0;
+    encwrapper->id = tx->NextBlockID++;
+    encwrapper->rphead = encwrapper->rpcnt = 0;
+    encwrapper->encoding = false;
+    TokenBucketInit(&encwrapper->tb, 1500); // 5ms Gap
+    tx->blocks[encwrapper->id % TXWINDOW] = encwrapper;
+    debug("enc[%u] init, total %u\n", encwrapper->id, ++tx->enc_cnt);
+    return encwrapper;
+}
+
+static EncWrapper *FindEnc(Transmitter *tx, uint32_t id)
+{
+    if (id - tx->OldestBlockID >= tx->NextBlockID - tx->OldestBlockID) return NULL;
+    return tx->blocks[id % TXWINDOW];
+}
+
+// The newest block, NULL once it is done.
+static EncWrapper *LastEnc(Transmitter *tx)
+{
+    return FindEnc(tx, tx->NextBlockID - 1);
+}
+
+// Blocks that may still be opened, the ring holds TXWINDOW at most.
+static uint32_t FreeBlocks(Transmitter *tx)
+{
+    // the sliding window streams everything through a single encoder
+    if (tx->cfg.codec == kodoc_sliding_window) return tx->OldestBlockID == tx->NextBlockID;
+    return TXWINDOW - (tx->NextBlockID - tx->OldestBlockID);
+}
+
+// The encoder new data goes to, NULL while every window is full.
+static EncWrapper *TailEnc(Transmitter *tx)
+{
+    EncWrapper *encwrapper = LastEnc(tx);
+    if (encwrapper != NULL && HasFreeSlot(tx, encwrapper)) return encwrapper;
+    return FreeBlocks(tx) > 0 ? NewEnc(tx) : NULL;
+}
+
+// Bytes that can be written at the cursor in one piece: up to the end of the
+// block, or of the free slots before the sliding window wraps.
+static size_t Contiguous(Transmitter *tx, EncWrapper *encwrapper)
+{
+    uint32_t nsym = encwrapper->nsym - encwrapper->lrank;
+    if (tx->cfg.codec == kodoc_sliding_window) {
+        nsym = tx->maxsymbol - (encwrapper->lrank - kodoc_window_lower(encwrapper->enc));
+        nsym = min(nsym, tx->maxsymbol - encwrapper->lrank % tx->maxsymbol);
+    }
+    return (size_t)nsym * tx->maxsymbolsize - tx->woff;
+}
+
+// Bytes that can be written at the cursor at all, across blocks that can
+// still be opened.
+static size_t Space(Transmitter *tx, EncWrapper *encwrapper)
+{
+    if (tx->cfg.codec != kodoc_sliding_window)
+        return Contiguous(tx, encwrapper) + (size_t)FreeBlocks(tx) * tx->blksize;
+    uint32_t nsym = tx->maxsymbol - (encwrapper->lrank - kodoc_window_lower(encwrapper->enc));
+    return (size_t)nsym * tx->maxsymbolsize - tx->woff;
+}
+
+// Hands the symbol at the cursor to the encoder, zero padded past 'used'
+// bytes, and sends it.
+static void PushSym(Transmitter *tx, EncWrapper *encwrapper, size_t used)
+{
+    uint8_t *psym = SymAt(tx, encwrapper, encwrapper->lrank);
+    memset(psym + used, 0, tx->maxsymbolsize - used);
+    kodoc_set_const_symbol(encwrapper->enc, encwrapper->lrank, psym, tx->maxsymbolsize);
+    encwrapper->lrank = kodoc_rank(encwrapper->enc);
+    tx->LastPushTS = GetTS();
+
+    EncodePkt(tx, encwrapper);
+}
+
+// Moves the cursor past 'n' bytes written at it, sending every symbol that
+// filled up. A symbol left with a single byte is closed too, the length of
+// the next message would not fit.
+static void Advance(Transmitter *tx, EncWrapper *encwrapper, size_t n)
+{
+    tx->woff += n;
+    while (tx->woff >= tx->maxsymbolsize) {
+        tx->woff -= tx->maxsymbolsize;
+        PushSym(tx, encwrapper, tx->maxsymbolsize);
+    }
+    if (tx->maxsymbolsize - tx->woff == 1) {
+        PushSym(tx, encwrapper, tx->woff);
+        tx->woff = 0;
+    }
+}
+
+// Returns where the application writes its next message of up to 'len'
+// bytes, or NULL while there is no room for it. The message is framed in
+// place in the block the encoder reads, only one that would cross into the
+// next block, or wrap the window, is staged and copied over by Commit().
+// Nothing else may be called on 'tx' until Commit(), and a new Reserve()
+// drops a reservation that was not committed.
+void *Reserve(Transmitter *tx, size_t len)
+{
+    size_t need = sizeof(uint16_t) + len;
+    assert(need <= UINT16_MAX);
+    tx->reserved = NULL;
+
+    EncWrapper *encwrapper = TailEnc(tx);
+    if (encwrapper == NULL) return NULL;
+
+    if (need <= Contiguous(tx, encwrapper))
+        tx->reserved = SymAt(tx, encwrapper, encwrapper->lrank) + tx->woff;
+    else if (need > Space(tx, encwrapper))
+        return NULL;
+    else
+        tx->reserved = tx->bounce;
+
+    tx->rsvlen = need;
+    return tx->reserved + sizeof(uint16_t);
+}
+
+// Queues the first 'len' bytes written to the last reservation.
+void Commit(Transmitter *tx, size_t len)
+{
+    uint16_t Len = sizeof(uint16_t) + len;
+    assert(tx->reserved != NULL && Len <= tx->rsvlen);
+    memcpy(tx->reserved, &Len, sizeof(Len));
+
+    if (tx->reserved != tx->bounce) {
+        Advance(tx, LastEnc(tx), Len);
+    } else {
+        for (uint8_t *psrc = tx->bounce; Len > 0; ) {
+            EncWrapper *encwrapper = TailEnc(tx);
+            assert(encwrapper != NULL);
+            size_t MaxCopyable = min((size_t)Len, Contiguous(tx, encwrapper));
+            memcpy(SymAt(tx, encwrapper, encwrapper->lrank) + tx->woff, psrc, MaxCopyable);
+            Advance(tx, encwrapper, MaxCopyable);
+            psrc += MaxCopyable; Len -= MaxCopyable;
         }
+    }
+
+    tx->reserved = NULL;
+}
+
+size_t Send(Transmitter *tx, void *buf, size_t buflen)
+{
+    void *pdst = Reserve(tx, buflen);
+    if (pdst == NULL) return 0;
+    memcpy(pdst, buf, buflen);
+    Commit(tx, buflen);
+
+    return buflen;
+}
+
+// Sends the symbol being filled as it is, so that everything committed so
+// far is on its way.
+void Transmitter_Push(Transmitter *tx)
+{
+    if (tx->woff > 0) {
+        PushSym(tx, LastEnc(tx), tx->woff);
+        tx->woff = 0;
+    }
+    SendQueued(tx);
+}
 
-        assert(encwrapper != NULL);
+// Closes the tail block at the symbols it holds, so that the receiver can
+// deliver it without waiting for it to fill.
+void Transmitter_Flush(Transmitter *tx)
+{
+    Transmitter_Push(tx);
 
-        Symbol *sym = NULL;
-        for (iqueue_head *p = tx->sym_queue.next, *nxt;
-             p != &tx->sym_queue && encwrapper->lrank < tx->maxsymbol; p = nxt) {
-            nxt = p->next;
-            sym = iqueue_entry(p, Symbol, qnode);
+    EncWrapper *encwrapper = LastEnc(tx);
+    if (tx->cfg.codec == kodoc_sliding_window || encwrapper == NULL) return;
 
-            void *pdst = encwrapper->pblk + encwrapper->lrank * tx->maxsymbolsize;
-            memcpy(pdst, sym->data, tx->maxsymbolsize);
-            kodoc_set_const_symbol(encwrapper->enc, encwrapper->lrank, pdst, tx->maxsymbolsize);
-            encwrapper->lrank = kodoc_rank(encwrapper->enc);
+    if (encwrapper->lrank > 0 && encwrapper->lrank < encwrapper->nsym) {
+        encwrapper->nsym = encwrapper->lrank;
+        debug("enc[%u] closed at %u symbols\n", encwrapper->id, encwrapper->nsym);
+    }
+}
 
-            tx->pktbuf->id = encwrapper->id;
-            kodoc_write_payload(encwrapper->enc, tx->pktbuf->data);
-            send(tx->DataSock, tx->pktbuf, sizeof(Packet) + tx->payload_size, 0);
+// What the receiver reports of a block: its rank, and how many of the
+// packets it sent made it so far.
+static void HandleBlockAck(Transmitter *tx, EncWrapper *encwrapper, uint32_t rank, uint32_t count)
+{
+    encwrapper->acked = max(encwrapper->acked, count);
+    // ValidAck() let no other rank through
+    if (tx->cfg.codec == kodoc_sliding_window) {
+        // cumulative: everything below rank is decoded
+        assert(rank <= encwrapper->lrank);
+    } else {
+        assert(rank > 0 && rank <= tx->maxsymbol);
+    }
+    if (rank > encwrapper->rrank) {
+        encwrapper->rrank = rank;
+        encwrapper->repairs = 0;
+    }
+    if (tx->cfg.codec == kodoc_sliding_window)
+        kodoc_read_feedback(encwrapper->enc, (uint8_t *)&encwrapper->rrank);
+}
 
-            iqueue_del(&sym->qnode);
-            free(sym);
+// Whether 'msg' is an ack the receiver could have sent: its length matches
+// its block count, it decoded no block that was never opened, and every
+// rank it reports is one the block can have.
+static bool ValidAck(Transmitter *tx, AckMsg *msg, size_t nbytes)
+{
+    if (nbytes < sizeof(AckMsg) || msg->nblk > RXWINDOW ||
+            nbytes != sizeof(AckMsg) + msg->nblk * sizeof(AckBlock) || msg->cumid > tx->NextBlockID)
+        return false;
+
+    for (uint32_t i = 0; i < msg->nblk; i++) {
+        uint32_t rank = msg->blocks[i].rank;
+        if (msg->blocks[i].count == 0) continue;
+        if (tx->cfg.codec != kodoc_sliding_window) {
+            if (rank == 0 || rank > tx->maxsymbol) return false;
+            continue;
         }
+        EncWrapper *encwrapper = FindEnc(tx, msg->cumid + i);
+        if (encwrapper != NULL && rank > encwrapper->lrank) return false;
+    }
+    return true;
+}
+
+static void HandleAck(Transmitter *tx, AckMsg *msg, size_t nbytes)
+{
+    if (nbytes < sizeof(AckMsg) || msg->conn != tx->conn) return;
+    // the port takes datagrams from anyone, a bad one must not stop us
+    if (!ValidAck(tx, msg, nbytes)) {
+        debug("invalid ack of %zu bytes dropped\n", nbytes);
+        return;
+    }
+
+    // blocks below the cumulative id are decoded, acks of blocks retired
+    // already are late duplicates
+    for (uint32_t id = tx->OldestBlockID; id != tx->NextBlockID && id < msg->cumid; id++) {
+        EncWrapper *encwrapper = FindEnc(tx, id);
+        if (encwrapper == NULL) continue;
+        HandleBlockAck(tx, encwrapper, tx->cfg.codec == kodoc_sliding_window ?
+                 encwrapper->lrank : tx->maxsymbol, encwrapper->acked);
+    }
+
+    for (uint32_t i = 0; i < msg->nblk; i++) {
+        EncWrapper *encwrapper = FindEnc(tx, msg->cumid + i);
+        if (encwrapper == NULL || msg->blocks[i].count == 0) continue;
+        HandleBlockAck(tx, encwrapper, msg->blocks[i].rank, msg->blocks[i].count);
     }
 }
 
 void CheckACK(Transmitter *tx)
 {
-    AckMsg msg;
+    uint32_t msg[ACKMAXLEN / sizeof(uint32_t)];
+
+    if (tx->backend == IO_URING) {
+        void *buf;
+        size_t nbytes;
+        uint16_t bid;
+        while ((buf = Uring_NextRecv(&tx->recvring, &nbytes, &bid, NULL)) != NULL) {
+            assert(nbytes <= sizeof(msg));
+            memcpy(msg, buf, nbytes);
+            Uring_Recycle(&tx->recvring, bid);
+            HandleAck(tx, (AckMsg *)msg, nbytes);
+        }
+        return;
+    }
 
     while (true) {
-        ssize_t nbytes = read(tx->SignalSock, &msg, sizeof(msg));
+        ssize_t nbytes = recv(tx->DataSock, msg, sizeof(msg), MSG_DONTWAIT);
         if (nbytes < 0) break;
-        assert(nbytes == sizeof(msg));
-
-        EncWrapper *encwrapper = NULL;
-        iqueue_foreach(encwrapper, &tx->enc_queue, EncWrapper, qnode) {
-            if (msg.id > encwrapper->id) continue;
-            else if (msg.id < encwrapper->id) break;
-            else {
-                assert(msg.id == encwrapper->id);
-                assert(msg.rank > 0 && msg.rank <= tx->maxsymbol);
-                encwrapper->rrank = max(encwrapper->rrank, msg.rank);
-//                debug("enc[%u] lrank updated: %u\n", encwrapper->id, encwrapper->lrank);
-            }
-        }
+        HandleAck(tx, (AckMsg *)msg, (size_t)nbytes);
     }
 }
 
+static bool EncFinished(Transmitter *tx, EncWrapper *encwrapper)
+{
+    // a sliding window is done once it sent every committed byte
+    if (tx->cfg.codec == kodoc_sliding_window)
+        return encwrapper->lrank > 0 && encwrapper->rrank == encwrapper->lrank &&
+               tx->woff == 0;
+    // the receiver acks maxsymbol once it decoded a block it knows is closed
+    return encwrapper->lrank == encwrapper->nsym && encwrapper->rrank == tx->maxsymbol;
+}
+
+static bool NeedRepair(Transmitter *tx, EncWrapper *encwrapper)
+{
+    if (encwrapper->lrank > encwrapper->rrank) return true;
+    // a flushed block may be fully decoded before the receiver learns its
+    // size, keep it coming until the receiver confirms
+    return tx->cfg.codec != kodoc_sliding_window &&
+           encwrapper->lrank == encwrapper->nsym && encwrapper->rrank < tx->maxsymbol;
+}
+
+// Frees the blocks that are done and sends a repair for the others that
+// have a token. The ring's oldest id moves up over retired blocks, in order.
 void Fountain(Transmitter *tx)
 {
-    EncWrapper *encwrapper = NULL;
-    for (iqueue_head *p = tx->enc_queue.next, *nxt; p != &tx->enc_queue; p = nxt) {
-        nxt = p->next;
-        encwrapper = iqueue_entry(p, EncWrapper, qnode);
-
-        // free the encoder that finished the job
-        if (encwrapper->lrank == tx->maxsymbol && encwrapper->rrank == tx->maxsymbol) {
-            debug("enc[%u] free, total %u\n", encwrapper->id, --tx->enc_cnt);
-            iqueue_del(&encwrapper->qnode);
-            free(encwrapper->pblk);
-            kodoc_delete_coder(encwrapper->enc);
-            free(encwrapper);
+    CollectBursts(tx);
+
+    for (uint32_t id = tx->OldestBlockID; id != tx->NextBlockID; id++) {
+        EncWrapper *encwrapper = FindEnc(tx, id);
+        if (encwrapper == NULL) continue;
+
+        // free the encoder that finished the job, once no thread has it
+        if (EncFinished(tx, encwrapper) && !encwrapper->encoding) {
+            double sample = 1.0 - (double)encwrapper->acked / max(encwrapper->sent, encwrapper->acked);
+            tx->loss += (sample - tx->loss) / 8;
+            debug("enc[%u] free, total %u, loss %.3f\n", encwrapper->id, --tx->enc_cnt, tx->loss);
+            tx->blocks[id % TXWINDOW] = NULL;
+            PutEnc(tx, encwrapper);
+        } else if (NeedRepair(tx, encwrapper) && !RepairAtHand(tx, encwrapper)) {
+            // its token keeps until the burst is back
         } else if (GetToken(&encwrapper->tb, sizeof(Packet) + tx->payload_size) &&
-                encwrapper->lrank > encwrapper->rrank) {
-            tx->pktbuf->id = encwrapper->id;
-            kodoc_write_payload(encwrapper->enc, tx->pktbuf->data);
-            send(tx->DataSock, tx->pktbuf, sizeof(Packet) + tx->payload_size, 0);
+                NeedRepair(tx, encwrapper)) {
+            size_t len;
+            Packet *pkt = NextRepair(tx, encwrapper, &len);
+            encwrapper->repairs++;
+            QueuePkt(tx, pkt, len);
         }
     }
+    SendQueued(tx);
+
+    while (tx->OldestBlockID != tx->NextBlockID && FindEnc(tx, tx->OldestBlockID) == NULL)
+        tx->OldestBlockID++;
 }
 
+// When the sender has something to do next without hearing from the
+// receiver: a repair whose token comes due, or the idle flush of the tail
+// block. -1 if only an ack can move things on.
+long Transmitter_Deadline(Transmitter *tx)
+{
+    long deadline = -1;
+
+    for (uint32_t id = tx->OldestBlockID; id != tx->NextBlockID; id++) {
+        EncWrapper *encwrapper = FindEnc(tx, id);
+        // a block an encoder thread has wakes us through burstfd
+        if (encwrapper == NULL || encwrapper->encoding || !NeedRepair(tx, encwrapper)) continue;
+        long due = TokenDeadline(&encwrapper->tb, sizeof(Packet) + tx->payload_size);
+        if (deadline < 0 || due < deadline) deadline = due;
+    }
+
+    EncWrapper *encwrapper = LastEnc(tx);
+    if (tx->cfg.codec != kodoc_sliding_window && encwrapper != NULL &&
+            encwrapper->lrank > 0 && encwrapper->lrank < encwrapper->nsym) {
+        long due = tx->LastPushTS + IDLEFLUSH;
+        if (deadline < 0 || due < deadline) deadline = due;
+    }
+
+    return deadline;
+}
 
-int main()
+
+int main(int argc, char *argv[])
 {
-    Transmitter *tx = Transmitter_Init(MAXSYMBOL, MAXSYMBOLSIZE);
+    LRTConfig cfg;
+    LRTConfig_Default(&cfg);
+    LRTConfig_Parse(&cfg, argc, argv);
+
+    Transmitter *tx = Transmitter_Init(&cfg);
 
     TokenBucket tb;
     TokenBucketInit(&tb, 5000); // equals to 1300Bps
 
     uint32_t seq = 0;
 
-    UserData_t ud;
-
-    do {
-        while (seq < LOOPCNT && GetToken(&tb, sizeof(ud)))  {
-            ud.seq = seq++;
-            ud.ts = GetTS();
-            memset(ud.buf, 'a' + (ud.seq * 3 / 2) % 26, PADLEN);
-            Send(tx, &ud, sizeof(ud));
-        }
+    UserData_t *ud;
 
-        Div2Sym(tx);
-        MovSym2Enc(tx);
+    while (true) {
+        // acks first, the blocks they complete make the room a full window
+        // waits for, and nothing wakes us for it later
         CheckACK(tx);
         Fountain(tx);
 
-        usleep(20);
+        // a reservation must be committed before anything else touches tx,
+        // so only a message that has its token reserves room
+        bool full = false;
+        while (seq < LOOPCNT && TokenDeadline(&tb, sizeof(*ud)) <= GetTS()) {
+            // the message is built right where the encoder will read it
+            if ((ud = Reserve(tx, sizeof(*ud))) == NULL) {
+                full = true;
+                break;
+            }
+            GetToken(&tb, sizeof(*ud));
+            ud->seq = seq++;
+            ud->ts = GetTS();
+            memset(ud->buf, 'a' + (ud->seq * 3 / 2) % 26, PADLEN);
+            Commit(tx, sizeof(*ud));
+        }
+
+        Transmitter_Push(tx);
+        if (GetTS() - tx->LastPushTS >= IDLEFLUSH) Transmitter_Flush(tx);
+
+        if (seq == LOOPCNT && tx->OldestBlockID == tx->NextBlockID) break;
 
-    } while (seq < LOOPCNT ||
-            !iqueue_is_empty(&tx->src_queue) ||
-            !iqueue_is_empty(&tx->sym_queue) ||
-            !iqueue_is_empty(&tx->enc_queue));
+        // sleep until an ack, a repair token, or the next message is due
+        long deadline = Transmitter_Deadline(tx);
+        if (seq < LOOPCNT && !full) {
+            long due = TokenDeadline(&tb, sizeof(*ud));
+            if (deadline < 0 || due < deadline) deadline = due;
+        }
+        Reactor_Wait(&tx->reactor, deadline);
+    }
 
     Transmitter_Release(tx);
 }
\ No newline at end of file
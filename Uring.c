@@ -0,0 +1,249 @@
+//
+// Just enough io_uring for linked send batches and a multishot receive,
+// on the raw syscalls.
+//
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "common.h"
+
+// the one buffer group a ring lends its receive buffers from
+#define BUFGROUP    (0)
+
+static int Enter(Uring *ring, uint32_t submit, uint32_t wait)
+{
+    return (int)syscall(__NR_io_uring_enter, ring->fd, submit, wait,
+                        wait > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+// Leaves the ring closed, fd -1, if the kernel has no io_uring for us.
+bool Uring_Init(Uring *ring, uint32_t entries)
+{
+    struct io_uring_params p;
+
+    memset(ring, 0, sizeof(*ring));
+    memset(&p, 0, sizeof(p));
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (ring->fd < 0) return false;
+
+    // one mapping for both rings, the kernels without it are long gone
+    ring->maplen = max(p.sq_off.array + p.sq_entries * sizeof(uint32_t),
+                       p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe));
+    ring->sqeslen = p.sq_entries * sizeof(struct io_uring_sqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->map = mmap(NULL, ring->maplen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring->fd, IORING_OFF_SQ_RING);
+        ring->sqes = mmap(NULL, ring->sqeslen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ring->fd, IORING_OFF_SQES);
+    }
+    if (ring->map == NULL || ring->map == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        if (ring->map != NULL && ring->map != MAP_FAILED) munmap(ring->map, ring->maplen);
+        if (ring->sqes != NULL && ring->sqes != MAP_FAILED) munmap(ring->sqes, ring->sqeslen);
+        close(ring->fd);
+        memset(ring, 0, sizeof(*ring));
+        ring->fd = -1;
+        return false;
+    }
+
+    ring->sqhead = ring->map + p.sq_off.head;
+    ring->sqtail = ring->map + p.sq_off.tail;
+    ring->sqmask = *(uint32_t *)(ring->map + p.sq_off.ring_mask);
+    ring->sqlocal = *ring->sqtail;
+    ring->cqhead = ring->map + p.cq_off.head;
+    ring->cqtail = ring->map + p.cq_off.tail;
+    ring->cqmask = *(uint32_t *)(ring->map + p.cq_off.ring_mask);
+    ring->cqes = ring->map + p.cq_off.cqes;
+
+    // slot i of the submission ring always holds sqe i
+    uint32_t *array = ring->map + p.sq_off.array;
+    for (uint32_t i = 0; i <= ring->sqmask; i++) array[i] = i;
+
+    ring->recvfd = -1;
+    return true;
+}
+
+void Uring_Release(Uring *ring)
+{
+    if (ring->fd < 0) return;
+
+    close(ring->fd);
+    munmap(ring->sqes, ring->sqeslen);
+    munmap(ring->map, ring->maplen);
+    if (ring->br != NULL) munmap(ring->br, ring->nbuf * sizeof(struct io_uring_buf));
+    free(ring->bufs);
+    ring->fd = -1;
+}
+
+static struct io_uring_sqe *GetSqe(Uring *ring)
+{
+    // callers never queue more than the ring holds before they submit
+    assert(ring->sqlocal - __atomic_load_n(ring->sqhead, __ATOMIC_ACQUIRE) <= ring->sqmask);
+
+    struct io_uring_sqe *sqe = &ring->sqes[ring->sqlocal++ & ring->sqmask];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+static void Submit(Uring *ring, uint32_t wait)
+{
+    uint32_t n = ring->sqlocal - *ring->sqtail;
+    __atomic_store_n(ring->sqtail, ring->sqlocal, __ATOMIC_RELEASE);
+    Enter(ring, n, wait);
+}
+
+static struct io_uring_cqe *PeekCqe(Uring *ring)
+{
+    uint32_t head = *ring->cqhead;
+    if (head == __atomic_load_n(ring->cqtail, __ATOMIC_ACQUIRE)) return NULL;
+    return &ring->cqes[head & ring->cqmask];
+}
+
+static void SeenCqe(Uring *ring)
+{
+    __atomic_store_n(ring->cqhead, *ring->cqhead + 1, __ATOMIC_RELEASE);
+}
+
+// Sends msgs[0..n-1] on 'fd' as one linked chain, so they leave in order
+// off a single submission, and waits for them. Like sendmmsg() it returns
+// how many went out before the first failure, or -1 and errno.
+int Uring_SendBatch(Uring *ring, int fd, struct mmsghdr *msgs, uint32_t n)
+{
+    assert(n <= ring->sqmask + 1);
+
+    for (uint32_t i = 0; i < n; i++) {
+        struct io_uring_sqe *sqe = GetSqe(ring);
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = fd;
+        sqe->addr = (uintptr_t)&msgs[i].msg_hdr;
+        sqe->len = 1;
+        sqe->user_data = i;
+        if (i + 1 < n) sqe->flags = IOSQE_IO_LINK;
+    }
+    Submit(ring, n);
+
+    // a failed send cancels the rest of the chain
+    uint32_t sent = 0;
+    int error = 0;
+    for (uint32_t done = 0; done < n; ) {
+        struct io_uring_cqe *cqe = PeekCqe(ring);
+        if (cqe == NULL) {
+            Enter(ring, 0, n - done);
+            continue;
+        }
+        if (cqe->res >= 0) sent++;
+        else if (error == 0 || error == -ECANCELED) error = cqe->res;
+        SeenCqe(ring);
+        done++;
+    }
+
+    if (sent > 0) return (int)sent;
+    errno = -error;
+    return -1;
+}
+
+static void ArmRecv(Uring *ring)
+{
+    struct io_uring_sqe *sqe = GetSqe(ring);
+    sqe->opcode = IORING_OP_RECV;
+    if (ring->recvhdr.msg_namelen > 0) {
+        sqe->opcode = IORING_OP_RECVMSG;
+        sqe->addr = (uintptr_t)&ring->recvhdr;
+        sqe->len = 1;
+    }
+    sqe->fd = ring->recvfd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFGROUP;
+    Submit(ring, 0);
+}
+
+// Hands buffer 'bid' back to the kernel for the receive to fill again.
+void Uring_Recycle(Uring *ring, uint16_t bid)
+{
+    struct io_uring_buf *buf = &ring->br->bufs[ring->brtail & (ring->nbuf - 1)];
+    buf->addr = (uintptr_t)(ring->bufs + bid * ring->buflen);
+    buf->len = (uint32_t)ring->buflen;
+    buf->bid = bid;
+    __atomic_store_n(&ring->br->tail, ++ring->brtail, __ATOMIC_RELEASE);
+}
+
+// Lends the kernel nbuf buffers of buflen bytes each, nbuf a power of 2, as
+// a registered buffer ring, and keeps a multishot receive on 'fd' that
+// fills them one datagram each. With a 'namelen' the receive is a recvmsg()
+// that keeps that much of every source address in front of the datagram.
+bool Uring_RecvMultishot(Uring *ring, int fd, uint32_t nbuf, size_t buflen, socklen_t namelen)
+{
+    assert((nbuf & (nbuf - 1)) == 0 && nbuf <= UINT16_MAX);
+
+    memset(&ring->recvhdr, 0, sizeof(ring->recvhdr));
+    ring->recvhdr.msg_namelen = namelen;
+    if (namelen > 0) buflen += sizeof(struct io_uring_recvmsg_out) + namelen;
+
+    ring->br = mmap(NULL, nbuf * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring->br == MAP_FAILED) {
+        ring->br = NULL;
+        return false;
+    }
+    ring->nbuf = nbuf;
+    ring->buflen = buflen;
+    ring->bufs = malloc(nbuf * buflen);
+    assert(ring->bufs != NULL);
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uintptr_t)ring->br;
+    reg.ring_entries = nbuf;
+    reg.bgid = BUFGROUP;
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0)
+        return false;
+
+    ring->brtail = 0;
+    for (uint32_t bid = 0; bid < nbuf; bid++)
+        Uring_Recycle(ring, (uint16_t)bid);
+
+    ring->recvfd = fd;
+    ArmRecv(ring);
+    return true;
+}
+
+// The next datagram the receive completed, NULL if there is none yet, and
+// where from in '*name' if the receive keeps that. Its buffer is the
+// caller's until Uring_Recycle(*bid).
+void *Uring_NextRecv(Uring *ring, size_t *len, uint16_t *bid, void **name)
+{
+    struct io_uring_cqe *cqe;
+
+    while ((cqe = PeekCqe(ring)) != NULL) {
+        int32_t res = cqe->res;
+        uint32_t flags = cqe->flags;
+        SeenCqe(ring);
+
+        // the kernel ends a multishot receive on errors, and when it ran
+        // out of buffers
+        if (!(flags & IORING_CQE_F_MORE)) ArmRecv(ring);
+        if (!(flags & IORING_CQE_F_BUFFER)) continue;
+
+        *bid = (uint16_t)(flags >> IORING_CQE_BUFFER_SHIFT);
+        if (res <= 0) {
+            Uring_Recycle(ring, *bid);
+            continue;
+        }
+        uint8_t *buf = ring->bufs + *bid * ring->buflen;
+        if (ring->recvhdr.msg_namelen == 0) {
+            *len = (size_t)res;
+            return buf;
+        }
+
+        // io_uring_recvmsg_out, the source address, then the datagram
+        struct io_uring_recvmsg_out *out = (struct io_uring_recvmsg_out *)buf;
+        if (out->flags & MSG_TRUNC) {
+            Uring_Recycle(ring, *bid);
+            continue;
+        }
+        *name = buf + sizeof(*out);
+        *len = out->payloadlen;
+        return buf + sizeof(*out) + ring->recvhdr.msg_namelen + out->controllen;
+    }
+    return NULL;
+}
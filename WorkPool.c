@@ -0,0 +1,122 @@
+//
+// A fork-join pool of threads that steal each other's tasks.
+//
+
+#include "common.h"
+
+// Takes the next task of the queue's owner from the front, or one for a
+// thief from the back, so that the two rarely meet. NULL if it ran dry.
+static void *Take(WorkQueue *queue, bool steal)
+{
+    void *task = NULL;
+
+    pthread_spin_lock(&queue->lock);
+    if (queue->head != queue->tail)
+        task = queue->tasks[steal ? --queue->tail : queue->head++];
+    pthread_spin_unlock(&queue->lock);
+    return task;
+}
+
+// Runs the tasks of queue 'self', then the others' until every queue is
+// empty. A thread is one of the run's workers for as long as it takes.
+static void Drain(WorkPool *pool, uint32_t self)
+{
+    uint32_t nqueue = pool->nthread + 1;
+    void *task;
+
+    while (true) {
+        while ((task = Take(&pool->queues[self], false)) != NULL)
+            pool->fn(pool->ctx, task);
+
+        uint32_t i;
+        for (i = 1; i < nqueue; i++) {
+            task = Take(&pool->queues[(self + i) % nqueue], true);
+            if (task != NULL) break;
+        }
+        if (task == NULL) return;
+        pool->fn(pool->ctx, task);
+    }
+}
+
+static void *Helper(void *arg)
+{
+    WorkPool *pool = ((WorkQueue *)arg)->pool;
+    uint32_t self = (uint32_t)((WorkQueue *)arg - pool->queues);
+
+    while (true) {
+        sem_wait(&pool->start);
+        if (__atomic_load_n(&pool->stop, __ATOMIC_ACQUIRE)) return NULL;
+        Drain(pool, self);
+        sem_post(&pool->finish);
+    }
+}
+
+// 'nthread' threads that help whoever calls WorkPool_Run(), none runs the
+// tasks on the caller alone.
+void WorkPool_Init(WorkPool *pool, uint32_t nthread, void (*fn)(void *ctx, void *task), void *ctx)
+{
+    pool->nthread = nthread;
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->stop = false;
+    sem_init(&pool->start, 0, 0);
+    sem_init(&pool->finish, 0, 0);
+
+    // the caller's queue is the last one
+    int rval = posix_memalign((void **)&pool->queues, ICACHELINE, (nthread + 1) * sizeof(WorkQueue));
+    assert(rval == 0);
+    pool->threads = malloc(nthread * sizeof(pthread_t));
+    assert(pool->threads != NULL || nthread == 0);
+
+    for (uint32_t i = 0; i <= nthread; i++) {
+        pthread_spin_init(&pool->queues[i].lock, PTHREAD_PROCESS_PRIVATE);
+        pool->queues[i].pool = pool;
+        pool->queues[i].head = pool->queues[i].tail = 0;
+    }
+    for (uint32_t i = 0; i < nthread; i++) {
+        rval = pthread_create(&pool->threads[i], NULL, Helper, &pool->queues[i]);
+        assert(rval == 0);
+    }
+}
+
+void WorkPool_Release(WorkPool *pool)
+{
+    __atomic_store_n(&pool->stop, true, __ATOMIC_RELEASE);
+    for (uint32_t i = 0; i < pool->nthread; i++)
+        sem_post(&pool->start);
+    for (uint32_t i = 0; i < pool->nthread; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    for (uint32_t i = 0; i <= pool->nthread; i++)
+        pthread_spin_destroy(&pool->queues[i].lock);
+    sem_destroy(&pool->start);
+    sem_destroy(&pool->finish);
+    free(pool->threads);
+    free(pool->queues);
+}
+
+// Calls fn(ctx, tasks[i]) for every one of the 'n' tasks, which must not
+// depend on each other, and returns once all of them are done. Each thread
+// starts on a slice of its own and steals from the others when it is
+// through, so uneven tasks still keep all of them busy.
+void WorkPool_Run(WorkPool *pool, void **tasks, uint32_t n)
+{
+    uint32_t nqueue = pool->nthread + 1;
+
+    if (pool->nthread == 0 || n <= 1) {
+        for (uint32_t i = 0; i < n; i++) pool->fn(pool->ctx, tasks[i]);
+        return;
+    }
+
+    for (uint32_t i = 0; i < nqueue; i++) {
+        pool->queues[i].tasks = tasks;
+        pool->queues[i].head = (uint32_t)((uint64_t)n * i / nqueue);
+        pool->queues[i].tail = (uint32_t)((uint64_t)n * (i + 1) / nqueue);
+    }
+
+    for (uint32_t i = 0; i < pool->nthread; i++)
+        sem_post(&pool->start);
+    Drain(pool, pool->nthread);
+    for (uint32_t i = 0; i < pool->nthread; i++)
+        sem_wait(&pool->finish);
+}
@@ -13,25 +13,84 @@
 #include <unistd.h>
 #include <sys/time.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include <arpa/inet.h>
 #include <fcntl.h>
 #include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <linux/io_uring.h>
 #include "GenericQueue.h"
 #include "kodoc/kodoc.h"
+#include "kodoc/kodoc_ext.h"
 
-#define SRC_IP      "127.0.0.1"
+// where a sender goes and a receiver listens by default, see -H and -P
 #define DST_IP      "127.0.0.1"
 #define DST_DPORT   7777
-#define SRC_SPORT   8888
 
 #define MAXSYMBOL       (256)
 #define MAXSYMBOLSIZE   (1024)
+#define MINSYMBOLSIZE   (512)
+
+// Reed-Solomon needs repair rows left over in GF(2^8)
+#define RSMAXSYMBOL     (128)
 
 #define LOOPCNT         (65536)
 
+// repairs encoded per pass over a block, see kodoc_write_payloads()
+#define REPAIRBURST     (8)
+
+// close a partially filled block after this long without new data, in ms
+#define IDLEFLUSH       (5)
+
 #define INTENDEDLEN     (1500)
 
+// blocks a receiver holds at once, newer ones wait for a slot
+#define RXWINDOW        (64)
+
+// blocks a sender keeps in flight, the receiver would drop more
+#define TXWINDOW        (RXWINDOW)
+
+// retired blocks each side keeps for reuse by default, see -b
+#define SPAREBLOCKS     (16)
+
+// datagrams per sendmmsg()/recvmmsg()
+#define IOBATCH         (32)
+
+// receive buffers lent to a multishot io_uring receive, a power of 2
+#define URINGBUFS       (256)
+
+// buckets of a receiver's connection table, a power of 2
+#define CONNBITS        (10)
+#define CONNBUCKETS     (1 << CONNBITS)
+
+// receiver threads at most, see -w
+#define MAXWORKERS      (256)
+
+// packets a receive batch decodes at once with decoder threads, see -j
+#define DECBATCH        (IOBATCH * 64)
+
+// a receiver acks a connection every ACKEVERY packets, or ACKDELAY ms after
+// the first one it has not acked, by default, see -a and -A
+#define ACKEVERY        (8)
+#define ACKDELAY        (1)
+// a sender held in the dark longer than this repairs blindly, in ms
+#define ACKMAXDELAY     (1000)
+
+// header-only packets a sender says goodbye with, any one of them will do
+#define CLOSECNT        (3)
+
+// a receiver drops a connection not heard from for this long, in ms, and
+// keeps the ids of the last TOMBSTONES closed ones out for as long
+#define CONNIDLE        (10000)
+#define TOMBSTONES      (64)
+
+// segments a received message may be lent in
+#define MAXIOV          (8)
+
 #define PADLEN          (INTENDEDLEN - sizeof(uint16_t) - sizeof(uint32_t) - sizeof(long))
 
 // Take care of 'Byte Alignment' !!
@@ -59,6 +118,127 @@ typedef struct {
 #define debug(fmt, ...) \
         do { fprintf(stderr, "%s()=> " fmt, __func__, __VA_ARGS__); } while (0)
 
+// Per-connection coding parameters, both ends must agree on them
+typedef struct {
+    int32_t codec;          // kodoc_codec
+    int32_t field;          // kodoc_finite_field
+    uint32_t maxsymbol;
+    uint32_t maxsymbolsize;
+    bool systematic;        // send every source symbol uncoded once
+    double density;         // sparse codecs only, sender side, 0 adapts to loss
+    uint32_t spare;         // retired blocks kept for reuse, local only
+    bool offload;           // UDP GSO/GRO where the kernel has it, local only
+    bool busypoll;          // spin on the sockets instead of sleeping, local only
+    int32_t backend;        // IO_EPOLL or IO_URING, local only
+    const char *host;       // peer of a sender, local address of a receiver
+    uint16_t port;
+    uint32_t workers;       // receiver threads sharing the port, local only
+    uint32_t encoders;      // sender threads encoding repair bursts, local only
+    uint32_t decoders;      // receiver threads decoding blocks, per worker, local only
+    uint32_t ackevery;      // packets a receiver acks at once at most, local only
+    uint32_t ackdelay;      // ms a receiver holds back an ack at most, local only
+} LRTConfig;
+
+// socket I/O backends, see -i
+enum { IO_EPOLL, IO_URING };
+
+void LRTConfig_Default(LRTConfig *cfg);
+void LRTConfig_Parse(LRTConfig *cfg, int argc, char *argv[]);
+
+// Free list of equally sized objects, threaded through the iqueue_head
+// every pooled object starts with. Grows by slabs, never shrinks.
+typedef struct {
+    iqueue_head free;
+    iqueue_head slabs;
+    size_t objsize;
+    uint32_t nfree, ntotal;
+} ObjPool;
+
+void ObjPool_Init(ObjPool *pool, size_t objsize);
+void ObjPool_Release(ObjPool *pool);
+void *ObjPool_Get(ObjPool *pool);
+void ObjPool_Put(ObjPool *pool, void *obj);
+
+// Block buffers carved out of 2MB chunks, backed by huge pages where the
+// system allows and placed on NUMA node 'node' unless it is -1. Free ones
+// are linked through their first bytes.
+typedef struct {
+    iqueue_head free;
+    iqueue_head chunks;
+    size_t bufsize, chunksize;
+    int node;
+    uint32_t nfree, ntotal;
+} Arena;
+
+int Arena_LocalNode(void);
+void Arena_Init(Arena *arena, size_t bufsize, int node);
+void Arena_Release(Arena *arena);
+void *Arena_Get(Arena *arena);
+void Arena_Put(Arena *arena, void *buf);
+
+// An epoll set of sockets plus a timerfd for the next pacing deadline.
+typedef struct {
+    int epfd, timerfd;
+    long armed;             // deadline the timer is set to, -1 if none
+    bool busy;
+} Reactor;
+
+void Reactor_Init(Reactor *reactor, bool busy);
+void Reactor_Release(Reactor *reactor);
+void Reactor_Add(Reactor *reactor, int fd);
+void Reactor_Wait(Reactor *reactor, long deadline);
+
+typedef struct WorkPool WorkPool;
+
+// The tasks one thread of a WorkPool runs, the others steal from its back.
+typedef struct {
+    pthread_spinlock_t lock;
+    uint32_t head, tail;
+    void **tasks;
+    WorkPool *pool;
+} __attribute__((aligned(ICACHELINE))) WorkQueue;
+
+struct WorkPool {
+    uint32_t nthread;       // besides the one calling WorkPool_Run()
+    pthread_t *threads;
+    WorkQueue *queues;      // one per thread, the caller's last
+    void (*fn)(void *ctx, void *task);
+    void *ctx;
+    sem_t start, finish;
+    bool stop;
+};
+
+void WorkPool_Init(WorkPool *pool, uint32_t nthread, void (*fn)(void *ctx, void *task), void *ctx);
+void WorkPool_Release(WorkPool *pool);
+void WorkPool_Run(WorkPool *pool, void **tasks, uint32_t n);
+
+// A raw io_uring, with a buffer ring for one multishot receive if it has one.
+typedef struct {
+    int fd;
+    void *map;              // submission and completion rings
+    size_t maplen;
+    struct io_uring_sqe *sqes;
+    size_t sqeslen;
+    uint32_t *sqhead, *sqtail, sqmask, sqlocal;
+    uint32_t *cqhead, *cqtail, cqmask;
+    struct io_uring_cqe *cqes;
+
+    int recvfd;
+    struct msghdr recvhdr;  // how much of a source address to keep, if any
+    struct io_uring_buf_ring *br;
+    uint8_t *bufs;
+    uint32_t nbuf;
+    size_t buflen;
+    uint16_t brtail;
+} Uring;
+
+bool Uring_Init(Uring *ring, uint32_t entries);
+void Uring_Release(Uring *ring);
+int Uring_SendBatch(Uring *ring, int fd, struct mmsghdr *msgs, uint32_t n);
+bool Uring_RecvMultishot(Uring *ring, int fd, uint32_t nbuf, size_t buflen, socklen_t namelen);
+void *Uring_NextRecv(Uring *ring, size_t *len, uint16_t *bid, void **name);
+void Uring_Recycle(Uring *ring, uint16_t bid);
+
 typedef struct {
     long ts;
     uint32_t CurCapactiy;
@@ -67,91 +247,258 @@ typedef struct {
 } TokenBucket;
 
 typedef struct {
-    iqueue_head qnode;
-    uint8_t data[0];
-    uint16_t Len;
-    uint8_t rawdata[0];
-} __attribute__((packed)) SrcData;
-
-typedef struct {
-    iqueue_head qnode;
-    uint8_t data[0];
-} Symbol;
-
-typedef struct {
-    iqueue_head qnode;
+    iqueue_head qnode;      // links it in EncPool or spare_queue while unused
     uint32_t id;
     kodoc_coder_t enc;
     uint32_t lrank, rrank;
+    uint32_t nsym;          // symbols the block closes at, maxsymbol unless flushed
+    uint32_t sent;          // packets written for this block
+    uint32_t acked;         // ... and received, as the receiver last acked
+    uint32_t repairs;       // repairs since rrank last moved
     uint8_t  *pblk;
     TokenBucket tb;
+
+    // a burst of encoded repairs waiting for tokens
+    uint8_t  *rpbuf;
+    uint32_t rplen[REPAIRBURST];
+    uint32_t rphead, rpcnt;
+    uint32_t rplrank, rplower;  // encoder window the burst covers
+    uint32_t rpburst;       // repairs the next burst is encoded with ...
+    double rpdensity;       // ... and their density, see PlanBurst()
+    bool encoding;          // an encoder thread has it, hands off
 } EncWrapper;
 
+typedef struct Transmitter Transmitter;
+
+// A thread encoding repair bursts of closed blocks, whose coders no longer
+// change, off the pacing thread. Blocks go there on 'jobs' and come back on
+// 'done', at most one burst per block in flight.
 typedef struct {
+    Transmitter *tx;
+    pthread_t thread;
+    sem_t wake;
+    ispsc_ring jobs, done;
+    void *jobslots[TXWINDOW], *doneslots[TXWINDOW];
+    bool stop;
+} EncThread;
+
+// Variable length: 'data' is a kodoc payload, whose coding header is as
+// compact as the codec allows (a seed, an index list, or a full vector).
+// A packet without one closes connection 'conn'. Packed, so that the header
+// is exactly what goes on the wire, no padding after 'nsym'.
+typedef struct {
+    uint32_t conn;          // picked by the sender, tells flows on a port apart
     uint32_t id;
+    uint16_t nsym;          // symbols in block 'id' once it is closed
     uint8_t data[0];
-} Packet;
+} __attribute__((packed)) Packet;
 
+// What the receiver holds of a block: its rank, maxsymbol once decoded,
+// cumulative for a sliding window, and how many packets of it came in.
 typedef struct {
-    uint32_t id;
     uint32_t rank;
-} AckMsg;
+    uint32_t count;
+} AckBlock;
 
+// Variable length: every block of connection 'conn' below 'cumid' is
+// decoded, blocks[i] is block cumid + i, one without packets yet has a
+// count of 0.
 typedef struct {
-    iqueue_head src_queue;
+    uint32_t conn;
+    uint32_t cumid;
+    uint32_t nblk;
+    AckBlock blocks[0];
+} AckMsg;
 
-    iqueue_head sym_queue;
+#define ACKMAXLEN       (sizeof(AckMsg) + RXWINDOW * sizeof(AckBlock))
+
+struct Transmitter {
+    LRTConfig cfg;
 
     kodoc_factory_t enc_factory;
 
     uint32_t maxsymbol, maxsymbolsize, blksize;
 
-    iqueue_head enc_queue;
+    // blocks OldestBlockID to NextBlockID - 1, in slot id % TXWINDOW,
+    // NULL once retired
+    EncWrapper *blocks[TXWINDOW];
     int enc_cnt;
 
-    uint32_t NextBlockID;
+    uint32_t NextBlockID, OldestBlockID;
 
-    Packet *pktbuf;
+    // packets waiting for the next sendmmsg(), see QueuePkt()
+    uint8_t *pktbuf;        // IOBATCH packets, for the ones encoded on the spot
+    struct mmsghdr txmsg[IOBATCH];
+    struct iovec txiov[IOBATCH];
+    uint8_t txctrl[IOBATCH][CMSG_SPACE(sizeof(uint16_t))];
+    uint32_t txcnt;
+    bool gso;               // runs of equal sized packets go out as one
     uint32_t payload_size;
 
-    int DataSock, SignalSock;
+    double loss;            // EWMA of unacknowledged packets per block
 
-} Transmitter;
+    long LastPushTS;        // last symbol handed to an encoder
 
-typedef struct {
-    iqueue_head qnode;
-    Packet *pkt;
-} ChainedPkt;
+    ObjPool EncPool;
+    Arena BlkArena;
+
+    // retired blocks ready for reuse, coder and buffers included
+    iqueue_head spare_queue;
+    uint32_t spare_cnt;
+
+    // messages are framed straight into the tail block, see Reserve()
+    uint32_t woff;          // write offset in the symbol being filled
+    uint8_t *reserved;      // framed message waiting for Commit()
+    uint32_t rsvlen;
+    uint8_t *bounce;        // stages a message crossing blocks
+
+    uint32_t conn;
+
+    int DataSock;           // connected, packets out and acks in
+    Reactor reactor;        // wakes on acks and pacing deadlines
+
+    int32_t backend;        // cfg.backend unless io_uring is not available
+    Uring sendring;         // data packets out
+    Uring recvring;         // acks in
+
+    // repair bursts of closed blocks are encoded on these, see -e
+    EncThread *encoders;
+    uint32_t nencoder;
+    int burstfd;            // eventfd an encoder signals a finished burst on
+};
 
 typedef struct {
-    iqueue_head qnode;
+    iqueue_head qnode;      // links it in DecPool or spare_queue while unused
     uint32_t id;
     kodoc_coder_t dec;
+    uint32_t nsym;          // smallest block size announced by the sender
+    uint32_t refs;          // read cursor and lent messages still in it
+    bool retired;           // fully decoded, only read from now on
     uint8_t  *pblk;
+
+    uint32_t pkts;          // packets that came in for it
+
+    // its packets of the receive batch, see BatchPkt()
+    iqueue_head bnode;
+    uint32_t bhead, btail;
+    bool wasdone;           // BlockDone() before the batch
 } DecWrapper;
 
+// A message Borrow() lent out of the blocks first.id to first.id + nblk - 1
 typedef struct {
-    Packet *pktbuf;
-    uint32_t payload_size;
+    iqueue_head qnode;
+    DecWrapper *first;
+    uint32_t nblk;
+    uint32_t sym;           // symbol its length field is in
+} LentMsg;
+
+typedef struct Listener Listener;
+typedef struct Receiver Receiver;
+
+// A packet waiting for the decoder threads, chained to the next one of its
+// block by index.
+typedef struct {
+    Receiver *rx;
+    DecWrapper *dec;
+    Packet *pkt;
+    uint32_t next;
+} DecItem;
+
+// One connection of a Listener, known by the id its sender picked.
+struct Receiver {
+    iqueue_head hnode;      // in its conn_table bucket, or ConnPool
+    iqueue_head rnode;      // in ready_queue while it has news
+    Listener *ls;
+    uint32_t conn;
+    struct sockaddr_in peer;    // acks go back here
+    bool closed;            // the sender is done, all of it was acked
+
+    // packets not acked yet, and when they are at the latest, see NoteAck()
+    iqueue_head anode;      // in ack_queue while there are any
+    uint32_t unacked;
+    long ackdue;
+
+    iqueue_head inode;      // in idle_queue, see Listener_Reap()
+    long LastHeardTS;
 
     uint32_t ExpectedBlockID;
     uint32_t ExpectedSymbolID;
 
-    iqueue_head pkt_queue;
+    // decoding blocks, and decoded ones that are still being read, in
+    // slot id % RXWINDOW
+    DecWrapper *blocks[RXWINDOW];
+    uint32_t dec_cnt;
+
+    // read cursor, the next message starts here
+    uint32_t ReadBlockID, ReadSymbolID, ReadOffset;
+
+    iqueue_head lent_queue;
+};
+
+// Any number of connections on one UDP port, with one coding
+// configuration, one event loop and pools shared by all of them.
+struct Listener {
+    LRTConfig cfg;
+    uint32_t worker;        // its socket's index in the SO_REUSEPORT group
+
+    // one recvmmsg() worth of datagrams, and the acks they trigger
+    uint8_t *pktbuf;
+    size_t rxslot;          // bytes per read, a GRO train may take 64KB
+    struct mmsghdr rxmsg[IOBATCH];
+    struct iovec rxiov[IOBATCH];
+    struct sockaddr_in rxaddr[IOBATCH];
+    uint8_t rxctrl[IOBATCH][CMSG_SPACE(sizeof(int))];
+    bool gro;
+    uint8_t *ackbuf;        // IOBATCH acks of up to ACKMAXLEN
+    struct sockaddr_in ackaddr[IOBATCH];
+    struct mmsghdr ackmsg[IOBATCH];
+    struct iovec ackiov[IOBATCH];
+    uint32_t ackcnt;
+    uint32_t payload_size;
 
     kodoc_factory_t dec_factory;
 
     uint32_t maxsymbol, maxsymbolsize, blksize;
 
-    iqueue_head dec_queue;
-
-    iqueue_head sym_queue;
-
-    uint32_t src_cnt;
-
-    iqueue_head src_queue;
-
-    int DataSock, SignalSock;
-} Receiver;
+    // connections by id, and the ones packets came in for since the
+    // application last looked, see Listener_Ready()
+    iqueue_head conn_table[CONNBUCKETS];
+    uint32_t conn_cnt;
+    iqueue_head ready_queue;
+    iqueue_head ack_queue;      // connections with an ack due, by ackdue
+    iqueue_head idle_queue;     // connections, least recently heard from first
+
+    // recently closed connections, whose stray packets must not reopen them
+    struct {
+        uint32_t conn;
+        long ts;
+    } tombs[TOMBSTONES];
+    uint32_t ntomb;
+    uint64_t malformed;     // datagrams too short or too long to be ours
+
+    ObjPool ConnPool, DecPool, LentPool;
+    Arena BlkArena;
+
+    // retired blocks ready for reuse, coder and buffer included
+    iqueue_head spare_queue;
+    uint32_t spare_cnt;
+
+    int DataSock;           // packets in and acks out, for every connection
+    Reactor reactor;        // wakes on data
+
+    int32_t backend;        // cfg.backend unless io_uring is not available
+    Uring sendring;         // acks out
+    Uring recvring;         // data packets in
+
+    // with decoder threads packets are decoded a receive batch at a time,
+    // the batch's blocks in parallel, see DecodeBatch()
+    WorkPool decoders;
+    DecItem *batch;         // DECBATCH packets, in arrival order
+    uint32_t batchcnt;
+    iqueue_head batch_queue;    // blocks with packets in the batch
+    DecWrapper **tasks;
+    uint16_t batchbid[IOBATCH];  // ring buffers the batch still reads
+    uint32_t nbid;
+};
 
 #endif //LLRTP_COMMON_H
@@ -0,0 +1,64 @@
+// In-tree extensions to the kodoc API, implemented by kodoc/ only.
+// They are not available with the prebuilt library.
+
+#pragma once
+
+#include "kodoc/kodoc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//------------------------------------------------------------------
+// BATCH ENCODER API
+//------------------------------------------------------------------
+
+/// Writes 'count' payloads as kodoc_write_payload() would, but encodes the
+/// coded ones together: every source symbol is read once per batch instead
+/// of once per payload.
+/// @param encoder The encoder to use
+/// @param payloads 'count' buffers of at least kodoc_payload_size() bytes
+/// @param sizes Receives the number of bytes written to each payload
+/// @param count The number of payloads to write
+KODOC_API
+void kodoc_write_payloads(kodoc_coder_t encoder, uint8_t **payloads, uint32_t *sizes, uint32_t count);
+
+//------------------------------------------------------------------
+// CODER RECYCLING API
+//------------------------------------------------------------------
+
+/// Returns a coder to the state kodoc_factory_build_coder() built it in,
+/// keeping its memory. Symbol storage, the systematic flag and the density
+/// are reset as well and have to be set again.
+/// @param coder The encoder/decoder to reset
+KODOC_API
+void kodoc_reset_coder(kodoc_coder_t coder);
+
+//------------------------------------------------------------------
+// SLIDING WINDOW API
+//------------------------------------------------------------------
+//
+// A kodoc_sliding_window coder holds a window of 'symbols' slots over an
+// unbounded stream. Symbol indices are absolute stream positions and slot
+// i % symbols stores index i. kodoc_rank() of the encoder is the number of
+// symbols pushed so far; kodoc_rank() of the decoder is the first index it
+// has not fully decoded, which is also what kodoc_write_feedback() reports
+// and what kodoc_read_feedback() slides the encoder window up to.
+
+/// Tells a sliding window decoder that the application is done with every
+/// symbol below 'index'. Their slots are recycled as soon as the encoder
+/// window has moved past them as well.
+/// @param decoder The decoder to update
+/// @param index One past the last consumed symbol
+KODOC_API
+void kodoc_release_symbols(kodoc_coder_t decoder, uint32_t index);
+
+/// Returns the oldest symbol index a sliding window coder still holds.
+/// @param coder The encoder/decoder to query
+/// @return The lower edge of the window
+KODOC_API
+uint32_t kodoc_window_lower(kodoc_coder_t coder);
+
+#ifdef __cplusplus
+}
+#endif
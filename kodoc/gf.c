@@ -0,0 +1,434 @@
+//
+// In-tree finite field arithmetic backing the kodoc API.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "gf.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GF_X86
+#endif
+
+uint8_t gf256_mul_table[256][256];
+uint8_t gf256_inv_table[256];
+uint8_t gf256_split[256][32] __attribute__((aligned(32)));
+
+uint8_t gf16_mul_table[16][16];
+uint8_t gf16_inv_table[16];
+uint8_t gf16_split[16][32] __attribute__((aligned(32)));
+
+//---------------------------------------------------------------------
+// scalar fallback
+//---------------------------------------------------------------------
+
+// The SIMD kernels finish their tails with these inline loops rather than by
+// calling a narrower kernel: jumping into legacy-SSE code with dirty upper
+// YMM/ZMM state costs more than the whole tail.
+static inline void muladd_tail(uint8_t *dst, const uint8_t *src, const uint8_t *tbl, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+        dst[i] ^= tbl[src[i] & 0x0f] ^ tbl[16 + (src[i] >> 4)];
+}
+
+static inline void mul_tail(uint8_t *dst, const uint8_t *tbl, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+        dst[i] = tbl[dst[i] & 0x0f] ^ tbl[16 + (dst[i] >> 4)];
+}
+
+static inline void add_tail(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+        dst[i] ^= src[i];
+}
+
+static void muladd_scalar(uint8_t *dst, const uint8_t *src, const uint8_t *tbl, size_t len)
+{
+    muladd_tail(dst, src, tbl, len);
+}
+
+static void mul_scalar(uint8_t *dst, const uint8_t *tbl, size_t len)
+{
+    mul_tail(dst, tbl, len);
+}
+
+static void add_scalar(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t a, b;
+        memcpy(&a, dst + i, sizeof(a));
+        memcpy(&b, src + i, sizeof(b));
+        a ^= b;
+        memcpy(dst + i, &a, sizeof(a));
+    }
+    add_tail(dst + i, src + i, len - i);
+}
+
+static void muladd_n_scalar(uint8_t *const *dst, const uint8_t *src, const uint8_t *const *tbl,
+                            size_t n, size_t len)
+{
+    for (size_t k = 0; k < n; k++)
+        muladd_tail(dst[k], src, tbl[k], len);
+}
+
+static const gf_kernel kernel_scalar = {
+    "scalar", muladd_scalar, mul_scalar, add_scalar, muladd_n_scalar
+};
+
+#ifdef GF_X86
+
+//---------------------------------------------------------------------
+// SSSE3: 16 bytes per pshufb pair
+//---------------------------------------------------------------------
+
+__attribute__((target("ssse3")))
+static void muladd_ssse3(uint8_t *dst, const uint8_t *src, const uint8_t *tbl, size_t len)
+{
+    const __m128i lo = _mm_loadu_si128((const __m128i *)tbl);
+    const __m128i hi = _mm_loadu_si128((const __m128i *)(tbl + 16));
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i l = _mm_shuffle_epi8(lo, _mm_and_si128(s, mask));
+        __m128i h = _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi64(s, 4), mask));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(d, _mm_xor_si128(l, h)));
+    }
+    muladd_tail(dst + i, src + i, tbl, len - i);
+}
+
+__attribute__((target("ssse3")))
+static void mul_ssse3(uint8_t *dst, const uint8_t *tbl, size_t len)
+{
+    const __m128i lo = _mm_loadu_si128((const __m128i *)tbl);
+    const __m128i hi = _mm_loadu_si128((const __m128i *)(tbl + 16));
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i l = _mm_shuffle_epi8(lo, _mm_and_si128(s, mask));
+        __m128i h = _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi64(s, 4), mask));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(l, h));
+    }
+    mul_tail(dst + i, tbl, len - i);
+}
+
+__attribute__((target("ssse3")))
+static void add_ssse3(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_xor_si128(d, s));
+    }
+    add_tail(dst + i, src + i, len - i);
+}
+
+__attribute__((target("ssse3")))
+static void muladd_n_ssse3(uint8_t *const *dst, const uint8_t *src, const uint8_t *const *tbl,
+                           size_t n, size_t len)
+{
+    const __m128i mask = _mm_set1_epi8(0x0f);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i sl = _mm_and_si128(s, mask);
+        __m128i sh = _mm_and_si128(_mm_srli_epi64(s, 4), mask);
+        for (size_t k = 0; k < n; k++) {
+            __m128i lo = _mm_loadu_si128((const __m128i *)tbl[k]);
+            __m128i hi = _mm_loadu_si128((const __m128i *)(tbl[k] + 16));
+            __m128i d = _mm_loadu_si128((const __m128i *)(dst[k] + i));
+            d = _mm_xor_si128(d, _mm_xor_si128(_mm_shuffle_epi8(lo, sl), _mm_shuffle_epi8(hi, sh)));
+            _mm_storeu_si128((__m128i *)(dst[k] + i), d);
+        }
+    }
+    for (size_t k = 0; k < n; k++)
+        muladd_tail(dst[k] + i, src + i, tbl[k], len - i);
+}
+
+static const gf_kernel kernel_ssse3 = {
+    "ssse3", muladd_ssse3, mul_ssse3, add_ssse3, muladd_n_ssse3
+};
+
+//---------------------------------------------------------------------
+// AVX2: 32 bytes per vpshufb pair, two vectors per iteration
+//---------------------------------------------------------------------
+
+__attribute__((target("avx2")))
+static void muladd_avx2(uint8_t *dst, const uint8_t *src, const uint8_t *tbl, size_t len)
+{
+    const __m256i lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)tbl));
+    const __m256i hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(tbl + 16)));
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+
+    for (; i + 64 <= len; i += 64) {
+        __m256i s0 = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i s1 = _mm256_loadu_si256((const __m256i *)(src + i + 32));
+        __m256i d0 = _mm256_loadu_si256((const __m256i *)(dst + i));
+        __m256i d1 = _mm256_loadu_si256((const __m256i *)(dst + i + 32));
+        __m256i l0 = _mm256_shuffle_epi8(lo, _mm256_and_si256(s0, mask));
+        __m256i l1 = _mm256_shuffle_epi8(lo, _mm256_and_si256(s1, mask));
+        __m256i h0 = _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(s0, 4), mask));
+        __m256i h1 = _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(s1, 4), mask));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(d0, _mm256_xor_si256(l0, h0)));
+        _mm256_storeu_si256((__m256i *)(dst + i + 32), _mm256_xor_si256(d1, _mm256_xor_si256(l1, h1)));
+    }
+    muladd_tail(dst + i, src + i, tbl, len - i);
+}
+
+__attribute__((target("avx2")))
+static void mul_avx2(uint8_t *dst, const uint8_t *tbl, size_t len)
+{
+    const __m256i lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)tbl));
+    const __m256i hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(tbl + 16)));
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i s = _mm256_loadu_si256((const __m256i *)(dst + i));
+        __m256i l = _mm256_shuffle_epi8(lo, _mm256_and_si256(s, mask));
+        __m256i h = _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi64(s, 4), mask));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(l, h));
+    }
+    mul_tail(dst + i, tbl, len - i);
+}
+
+__attribute__((target("avx2")))
+static void add_avx2(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i s = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_xor_si256(d, s));
+    }
+    add_tail(dst + i, src + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static void muladd_n_avx2(uint8_t *const *dst, const uint8_t *src, const uint8_t *const *tbl,
+                          size_t n, size_t len)
+{
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i s = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i sl = _mm256_and_si256(s, mask);
+        __m256i sh = _mm256_and_si256(_mm256_srli_epi64(s, 4), mask);
+        for (size_t k = 0; k < n; k++) {
+            __m256i lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)tbl[k]));
+            __m256i hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(tbl[k] + 16)));
+            __m256i d = _mm256_loadu_si256((const __m256i *)(dst[k] + i));
+            d = _mm256_xor_si256(d, _mm256_xor_si256(_mm256_shuffle_epi8(lo, sl),
+                                                     _mm256_shuffle_epi8(hi, sh)));
+            _mm256_storeu_si256((__m256i *)(dst[k] + i), d);
+        }
+    }
+    for (size_t k = 0; k < n; k++)
+        muladd_tail(dst[k] + i, src + i, tbl[k], len - i);
+}
+
+static const gf_kernel kernel_avx2 = {
+    "avx2", muladd_avx2, mul_avx2, add_avx2, muladd_n_avx2
+};
+
+//---------------------------------------------------------------------
+// AVX-512BW: 64 bytes per vpshufb pair
+//---------------------------------------------------------------------
+
+__attribute__((target("avx512f,avx512bw")))
+static void muladd_avx512(uint8_t *dst, const uint8_t *src, const uint8_t *tbl, size_t len)
+{
+    const __m512i lo = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)tbl));
+    const __m512i hi = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)(tbl + 16)));
+    const __m512i mask = _mm512_set1_epi8(0x0f);
+    size_t i = 0;
+
+    for (; i + 64 <= len; i += 64) {
+        __m512i s = _mm512_loadu_si512((const void *)(src + i));
+        __m512i d = _mm512_loadu_si512((const void *)(dst + i));
+        __m512i l = _mm512_shuffle_epi8(lo, _mm512_and_si512(s, mask));
+        __m512i h = _mm512_shuffle_epi8(hi, _mm512_and_si512(_mm512_srli_epi64(s, 4), mask));
+        // d ^ l ^ h in one ternary-logic op
+        _mm512_storeu_si512((void *)(dst + i), _mm512_ternarylogic_epi64(d, l, h, 0x96));
+    }
+    muladd_tail(dst + i, src + i, tbl, len - i);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void mul_avx512(uint8_t *dst, const uint8_t *tbl, size_t len)
+{
+    const __m512i lo = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)tbl));
+    const __m512i hi = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)(tbl + 16)));
+    const __m512i mask = _mm512_set1_epi8(0x0f);
+    size_t i = 0;
+
+    for (; i + 64 <= len; i += 64) {
+        __m512i s = _mm512_loadu_si512((const void *)(dst + i));
+        __m512i l = _mm512_shuffle_epi8(lo, _mm512_and_si512(s, mask));
+        __m512i h = _mm512_shuffle_epi8(hi, _mm512_and_si512(_mm512_srli_epi64(s, 4), mask));
+        _mm512_storeu_si512((void *)(dst + i), _mm512_xor_si512(l, h));
+    }
+    mul_tail(dst + i, tbl, len - i);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void add_avx512(uint8_t *dst, const uint8_t *src, size_t len)
+{
+    size_t i = 0;
+
+    for (; i + 64 <= len; i += 64) {
+        __m512i s = _mm512_loadu_si512((const void *)(src + i));
+        __m512i d = _mm512_loadu_si512((const void *)(dst + i));
+        _mm512_storeu_si512((void *)(dst + i), _mm512_xor_si512(d, s));
+    }
+    add_tail(dst + i, src + i, len - i);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void muladd_n_avx512(uint8_t *const *dst, const uint8_t *src, const uint8_t *const *tbl,
+                            size_t n, size_t len)
+{
+    const __m512i mask = _mm512_set1_epi8(0x0f);
+    size_t i = 0;
+
+    for (; i + 64 <= len; i += 64) {
+        __m512i s = _mm512_loadu_si512((const void *)(src + i));
+        __m512i sl = _mm512_and_si512(s, mask);
+        __m512i sh = _mm512_and_si512(_mm512_srli_epi64(s, 4), mask);
+        for (size_t k = 0; k < n; k++) {
+            __m512i lo = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)tbl[k]));
+            __m512i hi = _mm512_broadcast_i32x4(_mm_loadu_si128((const __m128i *)(tbl[k] + 16)));
+            __m512i d = _mm512_loadu_si512((const void *)(dst[k] + i));
+            d = _mm512_ternarylogic_epi64(d, _mm512_shuffle_epi8(lo, sl), _mm512_shuffle_epi8(hi, sh), 0x96);
+            _mm512_storeu_si512((void *)(dst[k] + i), d);
+        }
+    }
+    for (size_t k = 0; k < n; k++)
+        muladd_tail(dst[k] + i, src + i, tbl[k], len - i);
+}
+
+static const gf_kernel kernel_avx512 = {
+    "avx512", muladd_avx512, mul_avx512, add_avx512, muladd_n_avx512
+};
+
+#endif // GF_X86
+
+//---------------------------------------------------------------------
+// tables & dispatch
+//---------------------------------------------------------------------
+
+const gf_kernel *gf_active = &kernel_scalar;
+
+static const gf_kernel *supported[5];
+
+static void gf256_build_tables(void)
+{
+    uint8_t exp[512], log[256];
+    unsigned x = 1;
+
+    for (int i = 0; i < 255; i++) {
+        exp[i] = (uint8_t)x;
+        log[x] = (uint8_t)i;
+        x <<= 1;
+        if (x & 0x100) x ^= GF256_POLY;
+    }
+    for (int i = 255; i < 512; i++)
+        exp[i] = exp[i - 255];
+
+    for (int a = 0; a < 256; a++) {
+        for (int b = 0; b < 256; b++)
+            gf256_mul_table[a][b] = (a == 0 || b == 0) ? 0 : exp[log[a] + log[b]];
+        gf256_inv_table[a] = (a == 0) ? 0 : exp[255 - log[a]];
+    }
+
+    for (int c = 0; c < 256; c++) {
+        for (int n = 0; n < 16; n++) {
+            gf256_split[c][n] = gf256_mul_table[c][n];
+            gf256_split[c][16 + n] = gf256_mul_table[c][n << 4];
+        }
+    }
+}
+
+static void gf16_build_tables(void)
+{
+    for (int a = 0; a < 16; a++) {
+        for (int b = 0; b < 16; b++) {
+            unsigned p = 0, x = (unsigned)a;
+            for (int bit = 0; bit < 4; bit++) {
+                if (b & (1 << bit)) p ^= x;
+                x <<= 1;
+                if (x & 0x10) x ^= GF16_POLY;
+            }
+            gf16_mul_table[a][b] = (uint8_t)p;
+            if (p == 1) gf16_inv_table[a] = (uint8_t)b;
+        }
+    }
+
+    // the nibbles of a packed byte are independent elements
+    for (int c = 0; c < 16; c++) {
+        for (int n = 0; n < 16; n++) {
+            gf16_split[c][n] = gf16_mul_table[c][n];
+            gf16_split[c][16 + n] = (uint8_t)(gf16_mul_table[c][n] << 4);
+        }
+    }
+}
+
+static void gf_probe_kernels(void)
+{
+    int n = 0;
+
+#ifdef GF_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw")) supported[n++] = &kernel_avx512;
+    if (__builtin_cpu_supports("avx2")) supported[n++] = &kernel_avx2;
+    if (__builtin_cpu_supports("ssse3")) supported[n++] = &kernel_ssse3;
+#endif
+    supported[n++] = &kernel_scalar;
+    supported[n] = NULL;
+}
+
+const gf_kernel * const *gf_kernels(void)
+{
+    return supported;
+}
+
+int gf_select_kernel(const char *name)
+{
+    for (int i = 0; supported[i] != NULL; i++) {
+        if (strcmp(supported[i]->name, name) == 0) {
+            gf_active = supported[i];
+            return 1;
+        }
+    }
+    return 0;
+}
+
+__attribute__((constructor))
+void gf_init(void)
+{
+    static int done = 0;
+    if (done) return;
+    done = 1;
+
+    gf256_build_tables();
+    gf16_build_tables();
+    gf_probe_kernels();
+
+    gf_active = supported[0];
+
+    const char *forced = getenv("KODOC_SIMD");
+    if (forced != NULL) gf_select_kernel(forced);
+}
@@ -0,0 +1,77 @@
+//
+// In-tree finite field arithmetic backing the kodoc API.
+//
+
+#ifndef KODOC_GF_H
+#define KODOC_GF_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// GF(2^8) generated by x^8 + x^4 + x^3 + x^2 + 1 (0x11d)
+#define GF256_POLY      (0x11d)
+
+// GF(2^4) generated by x^4 + x + 1 (0x13), two elements per byte
+#define GF16_POLY       (0x13)
+
+// Region kernels. 'tbl' points to a split-nibble table pair: tbl[0..15] holds
+// c * x for the low nibble x, tbl[16..31] holds c * (x << 4) for the high one,
+// so c * b == tbl[b & 15] ^ tbl[16 + (b >> 4)].
+typedef struct {
+    const char *name;
+    // dst ^= c * src
+    void (*muladd)(uint8_t *dst, const uint8_t *src, const uint8_t *tbl, size_t len);
+    // dst = c * dst
+    void (*mul)(uint8_t *dst, const uint8_t *tbl, size_t len);
+    // dst ^= src
+    void (*add)(uint8_t *dst, const uint8_t *src, size_t len);
+    // dst[k] ^= c[k] * src for k < n, splitting each source vector only once
+    void (*muladd_n)(uint8_t *const *dst, const uint8_t *src, const uint8_t *const *tbl,
+                     size_t n, size_t len);
+} gf_kernel;
+
+extern const gf_kernel *gf_active;
+
+extern uint8_t gf256_mul_table[256][256];
+extern uint8_t gf256_inv_table[256];
+extern uint8_t gf256_split[256][32] __attribute__((aligned(32)));
+
+extern uint8_t gf16_mul_table[16][16];
+extern uint8_t gf16_inv_table[16];
+// c * x for a byte holding two GF(2^4) elements, same layout as gf256_split
+extern uint8_t gf16_split[16][32] __attribute__((aligned(32)));
+
+// Picks the widest kernel the CPU supports unless KODOC_SIMD names one
+// explicitly (scalar, ssse3, avx2, avx512).
+void gf_init(void);
+
+// Forces a kernel by name, returns 0 if it is unknown or unsupported here.
+int gf_select_kernel(const char *name);
+
+// NULL-terminated list of the kernels usable on this CPU.
+const gf_kernel * const *gf_kernels(void);
+
+static inline uint8_t gf256_mul(uint8_t a, uint8_t b)
+{
+    return gf256_mul_table[a][b];
+}
+
+static inline uint8_t gf256_inv(uint8_t a)
+{
+    return gf256_inv_table[a];
+}
+
+static inline void gf256_region_muladd(uint8_t *dst, const uint8_t *src, uint8_t c, size_t len)
+{
+    if (c == 0) return;
+    if (c == 1) gf_active->add(dst, src, len);
+    else gf_active->muladd(dst, src, gf256_split[c], len);
+}
+
+static inline void gf256_region_mul(uint8_t *dst, uint8_t c, size_t len)
+{
+    if (c == 1) return;
+    gf_active->mul(dst, gf256_split[c], len);
+}
+
+#endif //KODOC_GF_H
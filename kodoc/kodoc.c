@@ -0,0 +1,1371 @@
+//
+// In-tree implementation of the kodoc API subset used by LRT.
+//
+// Random linear network coding over GF(2), GF(2^4) and GF(2^8). The decoder
+// keeps its coding matrix in reduced row echelon form, so a symbol becomes
+// uncoded as soon as its row carries no coefficient besides its own pivot.
+// Uncoded rows are implicit unit vectors and never touch the matrix.
+//
+// Coefficients are held one element per byte internally and only packed
+// (8 per byte for GF(2), 2 per byte for GF(2^4)) on the wire. The seed
+// codecs only send the seed they were drawn from, the sparse full vector
+// codec falls back to an index list when that is shorter than the vector.
+//
+// The sliding window codec reuses the same elimination over a ring of
+// slots: column i of the matrix holds every absolute index = i mod symbols,
+// one at a time.
+//
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include "kodoc/kodoc.h"
+#include "kodoc/kodoc_ext.h"
+#include "gf.h"
+
+#define PAYLOAD_UNCODED     (0)
+#define PAYLOAD_CODED       (1)
+#define PAYLOAD_SPARSE      (2)
+
+// sparse coders default to half the coefficients being nonzero
+#define DEFAULT_DENSITY     (0.5)
+
+// kodoc_write_payloads() encodes up to this many payloads per pass, in
+// column chunks that keep the outputs and one source chunk within L1
+#define BATCH_MAX           (16)
+#define BATCH_L1_BYTES      (16 * 1024)
+
+#define SYMBOL_MISSING      (0)
+#define SYMBOL_CODED        (1)
+#define SYMBOL_UNCODED      (2)
+
+typedef struct codec_ops codec_ops;
+
+struct kodoc_factory {
+    const codec_ops *ops;
+    int32_t codec;
+    int32_t field;
+    uint8_t is_encoder;
+    uint32_t max_symbols, max_symbol_size;
+    uint32_t symbols, symbol_size;
+};
+
+struct kodoc_coder {
+    const codec_ops *ops;
+    int32_t codec;
+    int32_t field;
+    uint8_t is_encoder;
+    uint32_t symbols, symbol_size;
+    uint32_t vector_size;
+
+    // field arithmetic
+    uint8_t field_max;
+    const uint8_t (*split)[32];
+    const uint8_t *inv;
+
+    uint32_t rank;
+    uint8_t **data;
+    uint8_t *state;
+    uint8_t *coefs;
+    uint8_t *scratch;
+    uint64_t rng;
+
+    // sliding window only, 'base' stays 0 for block codecs
+    uint8_t window;
+    uint32_t base;      // oldest absolute index still held
+    uint32_t lower;     // decoder: highest encoder window edge seen
+    uint32_t consumed;  // decoder: application is done below this
+    uint32_t prefix;    // decoder: every index below is decoded
+
+    // encoder only
+    uint8_t systematic;
+    uint32_t next_uncoded;
+    uint32_t repair;
+    double density;
+    uint8_t *batch;     // BATCH_MAX coefficient vectors, allocated on first use
+
+    // decoder only
+    uint8_t *matrix;
+    uint32_t *coded;
+    uint32_t ncoded;
+    uint32_t uncoded;
+};
+
+// Per-codec wire format. Everything below the payload layer (elimination,
+// symbol storage, status queries) is shared.
+//
+// write_header() writes the header of the next packet and returns the
+// offset of its symbol. For a coded packet it fills 'coefs' and sets *slot
+// to 'symbols'; an uncoded one sets *slot to the symbol to copy instead.
+// Encoding is left to the caller so that packets can be encoded in batches.
+struct codec_ops {
+    uint32_t (*header_size)(int32_t field, uint32_t symbols);
+    uint32_t (*write_header)(kodoc_coder_t encoder, uint8_t *payload, uint8_t *coefs, uint32_t *slot);
+    void (*read_payload)(kodoc_coder_t decoder, uint8_t *payload);
+};
+
+//---------------------------------------------------------------------
+// helpers
+//---------------------------------------------------------------------
+
+static inline uint64_t splitmix64(uint64_t *s)
+{
+    uint64_t z = (*s += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static uint64_t new_seed(void)
+{
+    static uint64_t counter = 0;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    // coders may be built on several threads at once
+    uint64_t n = __atomic_add_fetch(&counter, 1, __ATOMIC_RELAXED);
+    uint64_t s = ((uint64_t)ts.tv_sec << 32) ^ (uint64_t)ts.tv_nsec ^ (n << 48);
+    return splitmix64(&s);
+}
+
+static void random_bytes(uint64_t *rng, uint8_t *dst, uint32_t len)
+{
+    uint32_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t r = splitmix64(rng);
+        memcpy(dst + i, &r, 8);
+    }
+    if (i < len) {
+        uint64_t r = splitmix64(rng);
+        memcpy(dst + i, &r, len - i);
+    }
+}
+
+// Maps a symbol index of the public API to its matrix column. Sliding window
+// indices outside the window map to 'symbols'.
+static inline uint32_t slot_of(kodoc_coder_t coder, uint32_t index)
+{
+    if (!coder->window) return index;
+    if (index < coder->base || index - coder->base >= coder->symbols) return coder->symbols;
+    return index % coder->symbols;
+}
+
+static inline uint8_t *row_of(kodoc_coder_t coder, uint32_t index)
+{
+    return coder->matrix + (size_t)index * coder->symbols;
+}
+
+static bool row_is_unit(kodoc_coder_t coder, uint32_t index)
+{
+    const uint8_t *row = row_of(coder, index);
+    for (uint32_t j = 0; j < coder->symbols; j++)
+        if (j != index && row[j] != 0) return false;
+    return true;
+}
+
+static void mark_uncoded(kodoc_coder_t coder, uint32_t index)
+{
+    coder->state[index] = SYMBOL_UNCODED;
+    coder->uncoded++;
+}
+
+//---------------------------------------------------------------------
+// finite fields
+//---------------------------------------------------------------------
+
+static inline void region_muladd(kodoc_coder_t coder, uint8_t *dst, const uint8_t *src,
+                                 uint8_t c, size_t len)
+{
+    if (c == 0) return;
+    if (c == 1) gf_active->add(dst, src, len);
+    else gf_active->muladd(dst, src, coder->split[c], len);
+}
+
+static inline void region_mul(kodoc_coder_t coder, uint8_t *dst, uint8_t c, size_t len)
+{
+    if (c == 1) return;
+    gf_active->mul(dst, coder->split[c], len);
+}
+
+static uint32_t vector_size(int32_t field, uint32_t symbols)
+{
+    switch (field) {
+        case kodoc_binary:  return (symbols + 7) / 8;
+        case kodoc_binary4: return (symbols + 1) / 2;
+        default:            return symbols;
+    }
+}
+
+static void pack_vector(kodoc_coder_t coder, uint8_t *dst, const uint8_t *coefs)
+{
+    const uint32_t n = coder->symbols;
+
+    switch (coder->field) {
+        case kodoc_binary:
+            memset(dst, 0, coder->vector_size);
+            for (uint32_t j = 0; j < n; j++)
+                dst[j >> 3] |= (uint8_t)(coefs[j] << (j & 7));
+            break;
+        case kodoc_binary4:
+            memset(dst, 0, coder->vector_size);
+            for (uint32_t j = 0; j < n; j++)
+                dst[j >> 1] |= (uint8_t)(coefs[j] << ((j & 1) * 4));
+            break;
+        default:
+            memcpy(dst, coefs, n);
+    }
+}
+
+static void unpack_vector(kodoc_coder_t coder, uint8_t *coefs, const uint8_t *src)
+{
+    const uint32_t n = coder->symbols;
+
+    switch (coder->field) {
+        case kodoc_binary:
+            for (uint32_t j = 0; j < n; j++)
+                coefs[j] = (uint8_t)((src[j >> 3] >> (j & 7)) & 1);
+            break;
+        case kodoc_binary4:
+            for (uint32_t j = 0; j < n; j++)
+                coefs[j] = (uint8_t)((src[j >> 1] >> ((j & 1) * 4)) & 0x0f);
+            break;
+        default:
+            memcpy(coefs, src, n);
+    }
+}
+
+//---------------------------------------------------------------------
+// decoding
+//---------------------------------------------------------------------
+
+// Eliminates one coded symbol against the current matrix and stores it if
+// it turns out to be innovative. Both 'coefs' and 'symbol' are clobbered.
+static void decode_symbol(kodoc_coder_t coder, uint8_t *coefs, uint8_t *symbol)
+{
+    const uint32_t n = coder->symbols, size = coder->symbol_size;
+
+    // forward: cancel every column that already has a pivot
+    for (uint32_t j = 0; j < n; j++) {
+        uint8_t c = coefs[j];
+        if (c == 0 || coder->state[j] == SYMBOL_MISSING) continue;
+
+        if (coder->state[j] == SYMBOL_UNCODED) {
+            coefs[j] = 0;
+        } else {
+            region_muladd(coder, coefs, row_of(coder, j), c, n);
+        }
+        region_muladd(coder, symbol, coder->data[j], c, size);
+    }
+
+    uint32_t pivot = 0;
+    while (pivot < n && coefs[pivot] == 0) pivot++;
+    if (pivot == n) return; // non-innovative
+
+    uint8_t inv = coder->inv[coefs[pivot]];
+    region_mul(coder, coefs, inv, n);
+    region_mul(coder, symbol, inv, size);
+
+    // backward: clear the new pivot column out of the partially decoded rows
+    for (uint32_t k = 0; k < coder->ncoded; ) {
+        uint32_t r = coder->coded[k];
+        uint8_t *row = row_of(coder, r);
+        uint8_t c = row[pivot];
+
+        if (c != 0) {
+            region_muladd(coder, row, coefs, c, n);
+            region_muladd(coder, coder->data[r], symbol, c, size);
+            if (row_is_unit(coder, r)) {
+                mark_uncoded(coder, r);
+                coder->coded[k] = coder->coded[--coder->ncoded];
+                continue;
+            }
+        }
+        k++;
+    }
+
+    memcpy(coder->data[pivot], symbol, size);
+    memcpy(row_of(coder, pivot), coefs, n);
+    coder->rank++;
+
+    if (row_is_unit(coder, pivot)) {
+        mark_uncoded(coder, pivot);
+    } else {
+        coder->state[pivot] = SYMBOL_CODED;
+        coder->coded[coder->ncoded++] = pivot;
+    }
+}
+
+static void decode_uncoded(kodoc_coder_t coder, const uint8_t *symbol, uint32_t index)
+{
+    if (coder->state[index] == SYMBOL_UNCODED) return;
+
+    // A pivot row already sits at 'index', so the symbol has to go through
+    // full elimination to land on some other column.
+    if (coder->state[index] == SYMBOL_CODED) {
+        memset(coder->coefs, 0, coder->symbols);
+        coder->coefs[index] = 1;
+        memcpy(coder->scratch, symbol, coder->symbol_size);
+        decode_symbol(coder, coder->coefs, coder->scratch);
+        return;
+    }
+
+    // Fast path: a unit row needs no forward elimination and never touches
+    // the matrix, only the coded rows that reference its column.
+    for (uint32_t k = 0; k < coder->ncoded; ) {
+        uint32_t r = coder->coded[k];
+        uint8_t *row = row_of(coder, r);
+        uint8_t c = row[index];
+
+        if (c != 0) {
+            row[index] = 0;
+            region_muladd(coder, coder->data[r], symbol, c, coder->symbol_size);
+            if (row_is_unit(coder, r)) {
+                mark_uncoded(coder, r);
+                coder->coded[k] = coder->coded[--coder->ncoded];
+                continue;
+            }
+        }
+        k++;
+    }
+
+    memcpy(coder->data[index], symbol, coder->symbol_size);
+    mark_uncoded(coder, index);
+    coder->rank++;
+}
+
+//---------------------------------------------------------------------
+// encoding
+//---------------------------------------------------------------------
+
+static void encode_symbol(kodoc_coder_t coder, uint8_t *symbol, const uint8_t *coefs)
+{
+    const uint32_t n = coder->symbols, size = coder->symbol_size;
+    bool first = true;
+
+    for (uint32_t j = 0; j < n; j++) {
+        if (coefs[j] == 0 || coder->state[j] == SYMBOL_MISSING) continue;
+
+        if (first) {
+            memcpy(symbol, coder->data[j], size);
+            region_mul(coder, symbol, coefs[j], size);
+            first = false;
+        } else {
+            region_muladd(coder, symbol, coder->data[j], coefs[j], size);
+        }
+    }
+
+    if (first) memset(symbol, 0, size);
+}
+
+// Encodes k symbols at once, 'coefs' holding one vector per output. The
+// loops are interchanged against encode_symbol(): each chunk of a source
+// symbol is loaded once and combined into all k outputs while it is hot.
+static void encode_batch(kodoc_coder_t coder, uint8_t **symbols, const uint8_t *coefs, uint32_t k)
+{
+    const uint32_t n = coder->symbols, size = coder->symbol_size;
+    uint32_t chunk = (BATCH_L1_BYTES / k) & ~63u;
+    uint8_t *dst[BATCH_MAX];
+    const uint8_t *tbl[BATCH_MAX];
+
+    if (chunk < 64) chunk = 64;
+
+    for (uint32_t off = 0; off < size; off += chunk) {
+        uint32_t len = size - off < chunk ? size - off : chunk;
+
+        for (uint32_t i = 0; i < k; i++) memset(symbols[i] + off, 0, len);
+
+        for (uint32_t j = 0; j < n; j++) {
+            uint32_t m = 0;
+
+            if (coder->state[j] == SYMBOL_MISSING) continue;
+            for (uint32_t i = 0; i < k; i++) {
+                uint8_t c = coefs[(size_t)i * n + j];
+                if (c == 0) continue;
+                // a plain xor beats splitting into nibbles, and is all GF(2) needs
+                if (c == 1) {
+                    gf_active->add(symbols[i] + off, coder->data[j] + off, len);
+                    continue;
+                }
+                dst[m] = symbols[i] + off;
+                tbl[m++] = coder->split[c];
+            }
+            if (m > 0) gf_active->muladd_n(dst, coder->data[j] + off, tbl, m, len);
+        }
+    }
+}
+
+// Random coefficients over the symbols the encoder holds, never all zero.
+static void generate_coefficients(kodoc_coder_t coder, uint8_t *coefs)
+{
+    if (coder->rank == coder->base) {
+        memset(coefs, 0, coder->symbols);
+        return;
+    }
+
+    bool nonzero = false;
+    while (!nonzero) {
+        random_bytes(&coder->rng, coefs, coder->symbols);
+        for (uint32_t j = 0; j < coder->symbols; j++) {
+            if (coder->state[j] == SYMBOL_MISSING) coefs[j] = 0;
+            else if ((coefs[j] &= coder->field_max) != 0) nonzero = true;
+        }
+    }
+}
+
+static uint32_t write_uncoded_header(kodoc_coder_t encoder, uint8_t *payload, uint32_t index,
+                                     uint32_t *slot)
+{
+    payload[0] = PAYLOAD_UNCODED;
+    memcpy(payload + 1, &index, sizeof(index));
+    *slot = slot_of(encoder, index);
+
+    return encoder->ops->header_size(encoder->field, encoder->symbols);
+}
+
+static void read_uncoded_payload(kodoc_coder_t decoder, uint8_t *payload)
+{
+    uint32_t index;
+    memcpy(&index, payload + 1, sizeof(index));
+    if (index >= decoder->symbols) return;
+    decode_uncoded(decoder, payload + decoder->ops->header_size(decoder->field, decoder->symbols), index);
+}
+
+//---------------------------------------------------------------------
+// full vector / on-the-fly: the whole coefficient vector rides along
+//---------------------------------------------------------------------
+
+static uint32_t vector_header_size(int32_t field, uint32_t symbols)
+{
+    uint32_t vs = vector_size(field, symbols);
+    return 1 + (vs > sizeof(uint32_t) ? vs : sizeof(uint32_t));
+}
+
+// In systematic mode every symbol goes out once as-is, in index order,
+// before any coded packet.
+static bool next_systematic(kodoc_coder_t encoder, uint32_t *index)
+{
+    if (!encoder->systematic) return false;
+
+    uint32_t slot = slot_of(encoder, encoder->next_uncoded);
+    if (slot < encoder->symbols && encoder->state[slot] != SYMBOL_MISSING) {
+        *index = encoder->next_uncoded++;
+        return true;
+    }
+    return false;
+}
+
+static uint32_t vector_write_header(kodoc_coder_t encoder, uint8_t *payload, uint8_t *coefs,
+                                    uint32_t *slot)
+{
+    uint32_t index;
+
+    if (next_systematic(encoder, &index))
+        return write_uncoded_header(encoder, payload, index, slot);
+
+    payload[0] = PAYLOAD_CODED;
+    generate_coefficients(encoder, coefs);
+    pack_vector(encoder, payload + 1, coefs);
+    *slot = encoder->symbols;
+
+    return vector_header_size(encoder->field, encoder->symbols);
+}
+
+static void vector_read_payload(kodoc_coder_t decoder, uint8_t *payload)
+{
+    const uint32_t hdrlen = vector_header_size(decoder->field, decoder->symbols);
+
+    if (payload[0] == PAYLOAD_UNCODED) {
+        read_uncoded_payload(decoder, payload);
+        return;
+    }
+
+    if (payload[0] != PAYLOAD_CODED) return;
+    unpack_vector(decoder, decoder->coefs, payload + 1);
+    decode_symbol(decoder, decoder->coefs, payload + hdrlen);
+}
+
+static const codec_ops vector_ops = {
+    vector_header_size, vector_write_header, vector_read_payload
+};
+
+// Fixed point density as carried on the wire, 0x10000 means dense.
+static uint32_t density_threshold(double density)
+{
+    uint32_t threshold = (uint32_t)(density * 65536.0);
+    return threshold < 1 ? 1 : threshold > 0xffff ? 0xffff : threshold;
+}
+
+// Draws coefficients for symbols [0, upper) from 'rng', skipping the ones
+// 'state' marks missing. Dense vectors are uniform over the field, sparse
+// ones are nonzero with probability threshold / 65536. At least one held
+// symbol always gets a nonzero coefficient. Deterministic in 'rng', so a
+// decoder holding the same seed regenerates the exact vector.
+static void draw_coefficients(kodoc_coder_t coder, uint64_t rng, uint8_t *coefs,
+                              uint32_t upper, uint32_t threshold, const uint8_t *state)
+{
+    bool nonzero = false;
+
+    memset(coefs + upper, 0, coder->symbols - upper);
+    if (upper == 0) return;
+
+    if (threshold > 0xffff) {
+        random_bytes(&rng, coefs, upper);
+        for (uint32_t j = 0; j < upper; j++) {
+            if (state != NULL && state[j] == SYMBOL_MISSING) coefs[j] = 0;
+            else if ((coefs[j] &= coder->field_max) != 0) nonzero = true;
+        }
+    } else {
+        for (uint32_t j = 0; j < upper; j++) {
+            uint64_t r = splitmix64(&rng);
+            if ((state != NULL && state[j] == SYMBOL_MISSING) || (r & 0xffff) >= threshold) {
+                coefs[j] = 0;
+            } else {
+                coefs[j] = (uint8_t)(1 + (r >> 16) % coder->field_max);
+                nonzero = true;
+            }
+        }
+    }
+
+    while (!nonzero) {
+        uint32_t j = (uint32_t)(splitmix64(&rng) % upper);
+        if (state == NULL || state[j] != SYMBOL_MISSING) {
+            coefs[j] = 1;
+            nonzero = true;
+        }
+    }
+}
+
+//---------------------------------------------------------------------
+// seed / sparse seed: the vector is regenerated from a 32-bit seed
+//---------------------------------------------------------------------
+//
+// Coded header: type, u16 upper, [u16 density,] u32 seed. The vector covers
+// symbols [0, upper), the prefix the encoder held when it wrote the packet.
+
+static uint32_t seed_header_size(int32_t field, uint32_t symbols)
+{
+    (void)field; (void)symbols;
+    return 1 + sizeof(uint16_t) + sizeof(uint32_t);
+}
+
+static uint32_t sparse_seed_header_size(int32_t field, uint32_t symbols)
+{
+    return seed_header_size(field, symbols) + sizeof(uint16_t);
+}
+
+static uint32_t seed_write_header(kodoc_coder_t encoder, uint8_t *payload, uint8_t *coefs,
+                                  uint32_t *slot)
+{
+    const bool sparse = encoder->codec == kodoc_sparse_seed;
+    uint8_t *p = payload + 1;
+    uint32_t index, seed, threshold = 0x10000;
+    uint16_t upper = 0;
+
+    if (next_systematic(encoder, &index))
+        return write_uncoded_header(encoder, payload, index, slot);
+
+    while (upper < encoder->symbols && encoder->state[upper] != SYMBOL_MISSING) upper++;
+
+    payload[0] = PAYLOAD_CODED;
+    memcpy(p, &upper, sizeof(upper));
+    p += sizeof(upper);
+    if (sparse) {
+        threshold = density_threshold(encoder->density);
+        uint16_t t = (uint16_t)threshold;
+        memcpy(p, &t, sizeof(t));
+        p += sizeof(t);
+    }
+    seed = (uint32_t)splitmix64(&encoder->rng);
+    memcpy(p, &seed, sizeof(seed));
+
+    draw_coefficients(encoder, seed, coefs, upper, threshold, NULL);
+    *slot = encoder->symbols;
+
+    return encoder->ops->header_size(encoder->field, encoder->symbols);
+}
+
+static void seed_read_payload(kodoc_coder_t decoder, uint8_t *payload)
+{
+    const uint32_t hdrlen = decoder->ops->header_size(decoder->field, decoder->symbols);
+    const uint8_t *p = payload + 1;
+    uint32_t seed, threshold = 0x10000;
+    uint16_t upper;
+
+    if (payload[0] == PAYLOAD_UNCODED) {
+        read_uncoded_payload(decoder, payload);
+        return;
+    }
+
+    if (payload[0] != PAYLOAD_CODED) return;
+    memcpy(&upper, p, sizeof(upper));
+    p += sizeof(upper);
+    if (decoder->codec == kodoc_sparse_seed) {
+        uint16_t t;
+        memcpy(&t, p, sizeof(t));
+        p += sizeof(t);
+        threshold = t;
+    }
+    memcpy(&seed, p, sizeof(seed));
+    if (upper > decoder->symbols) return;
+
+    draw_coefficients(decoder, seed, decoder->coefs, upper, threshold, NULL);
+    decode_symbol(decoder, decoder->coefs, payload + hdrlen);
+}
+
+static const codec_ops seed_ops = {
+    seed_header_size, seed_write_header, seed_read_payload
+};
+
+static const codec_ops sparse_seed_ops = {
+    sparse_seed_header_size, seed_write_header, seed_read_payload
+};
+
+//---------------------------------------------------------------------
+// sparse full vector: packed vector or (u16 index, u8 coefficient) list
+//---------------------------------------------------------------------
+//
+// The header size is that of the packed vector. A sparse packet is shorter:
+// type, u16 count, the list, then the symbol right after it.
+
+#define SPARSE_ENTRY_SIZE   (sizeof(uint16_t) + 1)
+
+static uint32_t sparse_write_header(kodoc_coder_t encoder, uint8_t *payload, uint8_t *coefs,
+                                    uint32_t *slot)
+{
+    const uint32_t n = encoder->symbols;
+    const uint32_t hdrlen = vector_header_size(encoder->field, n);
+    uint32_t index;
+    uint16_t count = 0;
+
+    if (next_systematic(encoder, &index))
+        return write_uncoded_header(encoder, payload, index, slot);
+
+    draw_coefficients(encoder, splitmix64(&encoder->rng), coefs, n,
+                      density_threshold(encoder->density), encoder->state);
+    for (uint32_t j = 0; j < n; j++) count += coefs[j] != 0;
+    *slot = n;
+
+    if (1 + sizeof(count) + count * SPARSE_ENTRY_SIZE >= hdrlen) {
+        payload[0] = PAYLOAD_CODED;
+        pack_vector(encoder, payload + 1, coefs);
+        return hdrlen;
+    }
+
+    uint8_t *p = payload;
+    *p++ = PAYLOAD_SPARSE;
+    memcpy(p, &count, sizeof(count));
+    p += sizeof(count);
+    for (uint16_t j = 0; j < n; j++) {
+        if (coefs[j] == 0) continue;
+        memcpy(p, &j, sizeof(j));
+        p[sizeof(j)] = coefs[j];
+        p += SPARSE_ENTRY_SIZE;
+    }
+
+    return (uint32_t)(p - payload);
+}
+
+static void sparse_read_payload(kodoc_coder_t decoder, uint8_t *payload)
+{
+    if (payload[0] != PAYLOAD_SPARSE) {
+        vector_read_payload(decoder, payload);
+        return;
+    }
+
+    const uint32_t hdrlen = vector_header_size(decoder->field, decoder->symbols);
+    uint8_t *p = payload + 1;
+    uint16_t count, j;
+
+    memcpy(&count, p, sizeof(count));
+    p += sizeof(count);
+    // the list is shorter than the packed vector, or it would not be sent
+    if (1 + sizeof(count) + count * SPARSE_ENTRY_SIZE >= hdrlen) return;
+    memset(decoder->coefs, 0, decoder->symbols);
+    for (uint16_t k = 0; k < count; k++, p += SPARSE_ENTRY_SIZE) {
+        memcpy(&j, p, sizeof(j));
+        if (j >= decoder->symbols) return;
+        decoder->coefs[j] = p[sizeof(j)];
+    }
+    decode_symbol(decoder, decoder->coefs, p);
+}
+
+static const codec_ops sparse_ops = {
+    vector_header_size, sparse_write_header, sparse_read_payload
+};
+
+//---------------------------------------------------------------------
+// Reed-Solomon: systematic, repairs are rows of a Cauchy matrix
+//---------------------------------------------------------------------
+//
+// Repair i of an encoder holding 'rank' symbols combines symbol j with
+// 1 / (x_i + j), x_i = symbols + i mod (256 - symbols). Any square
+// sub-matrix of a Cauchy matrix is invertible, so every repair is
+// innovative until 256 - symbols of them have been sent.
+
+#define RS_HEADER_SIZE      (1 + sizeof(uint32_t))
+
+static uint32_t rs_header_size(int32_t field, uint32_t symbols)
+{
+    (void)field; (void)symbols;
+    return RS_HEADER_SIZE;
+}
+
+static void rs_coefficients(kodoc_coder_t coder, uint8_t *coefs, uint32_t rank, uint32_t index)
+{
+    const uint32_t n = coder->symbols;
+    uint8_t x = (uint8_t)(n + index % (256 - n));
+
+    for (uint32_t j = 0; j < n; j++)
+        coefs[j] = j < rank ? gf256_inv((uint8_t)(x ^ j)) : 0;
+}
+
+static uint32_t rs_write_header(kodoc_coder_t encoder, uint8_t *payload, uint8_t *coefs,
+                                uint32_t *slot)
+{
+    uint32_t index;
+
+    if (next_systematic(encoder, &index))
+        return write_uncoded_header(encoder, payload, index, slot);
+
+    uint16_t rank = (uint16_t)encoder->rank, repair = (uint16_t)encoder->repair++;
+    payload[0] = PAYLOAD_CODED;
+    memcpy(payload + 1, &rank, sizeof(rank));
+    memcpy(payload + 1 + sizeof(rank), &repair, sizeof(repair));
+
+    rs_coefficients(encoder, coefs, rank, repair);
+    *slot = encoder->symbols;
+
+    return RS_HEADER_SIZE;
+}
+
+static void rs_read_payload(kodoc_coder_t decoder, uint8_t *payload)
+{
+    if (payload[0] == PAYLOAD_UNCODED) {
+        read_uncoded_payload(decoder, payload);
+        return;
+    }
+
+    uint16_t rank, index;
+    if (payload[0] != PAYLOAD_CODED) return;
+    memcpy(&rank, payload + 1, sizeof(rank));
+    memcpy(&index, payload + 1 + sizeof(rank), sizeof(index));
+    if (rank > decoder->symbols) return;
+
+    rs_coefficients(decoder, decoder->coefs, rank, index);
+    decode_symbol(decoder, decoder->coefs, payload + RS_HEADER_SIZE);
+}
+
+static const codec_ops rs_ops = {
+    rs_header_size, rs_write_header, rs_read_payload
+};
+
+//---------------------------------------------------------------------
+// sliding window: coded packets cover the encoder window [lower, upper)
+//---------------------------------------------------------------------
+//
+// Both packet types carry two absolute indices, then a coefficient vector
+// whose entry k belongs to index lower + k:
+//   uncoded: index, encoder lower edge
+//   coded:   lower, upper
+
+static uint32_t window_header_size(int32_t field, uint32_t symbols)
+{
+    return 1 + 2 * sizeof(uint32_t) + vector_size(field, symbols);
+}
+
+static void window_slide_encoder(kodoc_coder_t encoder, uint32_t lower)
+{
+    lower = lower < encoder->rank ? lower : encoder->rank;
+
+    for (; encoder->base < lower; encoder->base++) {
+        uint32_t slot = encoder->base % encoder->symbols;
+        encoder->state[slot] = SYMBOL_MISSING;
+        encoder->data[slot] = NULL;
+    }
+    if (encoder->next_uncoded < encoder->base)
+        encoder->next_uncoded = encoder->base;
+}
+
+// Recycles the slots both ends are done with and advances the decoded prefix.
+// The prefix must not count partially decoded pivots: the encoder stops
+// coding over everything below it, so only fully decoded symbols qualify.
+static void window_advance(kodoc_coder_t decoder)
+{
+    while (decoder->base < decoder->consumed && decoder->base < decoder->lower) {
+        uint32_t slot = decoder->base % decoder->symbols;
+        assert(decoder->state[slot] == SYMBOL_UNCODED);
+        decoder->state[slot] = SYMBOL_MISSING;
+        decoder->uncoded--;
+        decoder->rank--;
+        decoder->base++;
+    }
+
+    if (decoder->prefix < decoder->base) decoder->prefix = decoder->base;
+    while (decoder->prefix - decoder->base < decoder->symbols &&
+            decoder->state[decoder->prefix % decoder->symbols] == SYMBOL_UNCODED)
+        decoder->prefix++;
+}
+
+static uint32_t window_write_header(kodoc_coder_t encoder, uint8_t *payload, uint8_t *coefs,
+                                    uint32_t *slot)
+{
+    const uint32_t n = encoder->symbols;
+    uint32_t index, lower = encoder->base, upper = encoder->rank;
+
+    if (next_systematic(encoder, &index)) {
+        write_uncoded_header(encoder, payload, index, slot);
+        memcpy(payload + 1 + sizeof(index), &lower, sizeof(lower));
+        return window_header_size(encoder->field, n);
+    }
+
+    payload[0] = PAYLOAD_CODED;
+    memcpy(payload + 1, &lower, sizeof(lower));
+    memcpy(payload + 1 + sizeof(lower), &upper, sizeof(upper));
+
+    generate_coefficients(encoder, coefs);
+    memset(encoder->scratch, 0, n);
+    for (uint32_t k = 0; k < upper - lower; k++)
+        encoder->scratch[k] = coefs[(lower + k) % n];
+    pack_vector(encoder, payload + 1 + 2 * sizeof(uint32_t), encoder->scratch);
+    *slot = n;
+
+    return window_header_size(encoder->field, n);
+}
+
+static void window_read_payload(kodoc_coder_t decoder, uint8_t *payload)
+{
+    const uint32_t n = decoder->symbols;
+    const uint32_t hdrlen = window_header_size(decoder->field, n);
+    uint32_t a, b;
+
+    memcpy(&a, payload + 1, sizeof(a));
+    memcpy(&b, payload + 1 + sizeof(a), sizeof(b));
+
+    if (payload[0] == PAYLOAD_UNCODED) {
+        if (b > decoder->lower) decoder->lower = b;
+        window_advance(decoder);
+        // stale or beyond the window: drop it, a later repair covers it
+        uint32_t slot = slot_of(decoder, a);
+        if (slot < n) decode_uncoded(decoder, payload + hdrlen, slot);
+    } else {
+        if (payload[0] != PAYLOAD_CODED || a > b || b - a > n) return;
+        // references symbols already recycled here
+        if (a < decoder->base) return;
+        if (a > decoder->lower) decoder->lower = a;
+        window_advance(decoder);
+        // the application still holds the slots this one needs
+        if (b - decoder->base > n) return;
+
+        unpack_vector(decoder, decoder->scratch, payload + 1 + 2 * sizeof(uint32_t));
+        memset(decoder->coefs, 0, n);
+        for (uint32_t k = 0; k < b - a; k++)
+            decoder->coefs[(a + k) % n] = decoder->scratch[k];
+        decode_symbol(decoder, decoder->coefs, payload + hdrlen);
+    }
+
+    window_advance(decoder);
+}
+
+static const codec_ops window_ops = {
+    window_header_size, window_write_header, window_read_payload
+};
+
+static const codec_ops *codec_lookup(int32_t codec)
+{
+    switch (codec) {
+        case kodoc_full_vector:
+        case kodoc_on_the_fly:            return &vector_ops;
+        case kodoc_sparse_full_vector:    return &sparse_ops;
+        case kodoc_seed:                  return &seed_ops;
+        case kodoc_sparse_seed:           return &sparse_seed_ops;
+        case kodoc_sliding_window:        return &window_ops;
+        case kodoc_reed_solomon:          return &rs_ops;
+        default:                          return NULL;
+    }
+}
+
+//---------------------------------------------------------------------
+// FACTORY API
+//---------------------------------------------------------------------
+
+uint8_t kodoc_has_codec(int32_t codec)
+{
+    return codec_lookup(codec) != NULL;
+}
+
+static kodoc_factory_t new_factory(int32_t codec, int32_t finite_field,
+                                   uint32_t max_symbols, uint32_t max_symbol_size,
+                                   uint8_t is_encoder)
+{
+    const codec_ops *ops = codec_lookup(codec);
+    if (ops == NULL) return NULL;
+    if (finite_field != kodoc_binary && finite_field != kodoc_binary4 &&
+            finite_field != kodoc_binary8) return NULL;
+    // Reed-Solomon needs spare field elements for its repair rows
+    if (codec == kodoc_reed_solomon && (finite_field != kodoc_binary8 || max_symbols > 255))
+        return NULL;
+    // the compact headers carry symbol indices as u16
+    if ((codec == kodoc_sparse_full_vector || codec == kodoc_seed || codec == kodoc_sparse_seed) &&
+            max_symbols > 0xffff)
+        return NULL;
+    assert(max_symbols > 0 && max_symbol_size > 0);
+
+    gf_init();
+
+    kodoc_factory_t factory = malloc(sizeof(struct kodoc_factory));
+    assert(factory != NULL);
+
+    factory->ops = ops;
+    factory->codec = codec;
+    factory->field = finite_field;
+    factory->is_encoder = is_encoder;
+    factory->max_symbols = factory->symbols = max_symbols;
+    factory->max_symbol_size = factory->symbol_size = max_symbol_size;
+
+    return factory;
+}
+
+kodoc_factory_t kodoc_new_encoder_factory(
+    int32_t codec, int32_t finite_field,
+    uint32_t max_symbols, uint32_t max_symbol_size)
+{
+    return new_factory(codec, finite_field, max_symbols, max_symbol_size, 1);
+}
+
+kodoc_factory_t kodoc_new_decoder_factory(
+    int32_t codec, int32_t finite_field,
+    uint32_t max_symbols, uint32_t max_symbol_size)
+{
+    return new_factory(codec, finite_field, max_symbols, max_symbol_size, 0);
+}
+
+void kodoc_delete_factory(kodoc_factory_t factory)
+{
+    free(factory);
+}
+
+uint32_t kodoc_factory_max_symbols(kodoc_factory_t factory)
+{
+    return factory->max_symbols;
+}
+
+uint32_t kodoc_factory_max_symbol_size(kodoc_factory_t factory)
+{
+    return factory->max_symbol_size;
+}
+
+uint32_t kodoc_factory_max_block_size(kodoc_factory_t factory)
+{
+    return factory->max_symbols * factory->max_symbol_size;
+}
+
+uint32_t kodoc_factory_max_payload_size(kodoc_factory_t factory)
+{
+    return factory->ops->header_size(factory->field, factory->max_symbols) +
+           factory->max_symbol_size;
+}
+
+void kodoc_factory_set_symbols(kodoc_factory_t factory, uint32_t symbols)
+{
+    assert(symbols > 0 && symbols <= factory->max_symbols);
+    factory->symbols = symbols;
+}
+
+void kodoc_factory_set_symbol_size(kodoc_factory_t factory, uint32_t symbol_size)
+{
+    assert(symbol_size > 0 && symbol_size <= factory->max_symbol_size);
+    factory->symbol_size = symbol_size;
+}
+
+kodoc_coder_t kodoc_factory_build_coder(kodoc_factory_t factory)
+{
+    kodoc_coder_t coder = calloc(1, sizeof(struct kodoc_coder));
+    assert(coder != NULL);
+
+    coder->ops = factory->ops;
+    coder->codec = factory->codec;
+    coder->field = factory->field;
+    coder->is_encoder = factory->is_encoder;
+    coder->symbols = factory->symbols;
+    coder->symbol_size = factory->symbol_size;
+    coder->vector_size = vector_size(factory->field, factory->symbols);
+    coder->rng = new_seed();
+    // Reed-Solomon is systematic by construction
+    coder->systematic = coder->codec == kodoc_reed_solomon;
+    coder->window = coder->codec == kodoc_sliding_window;
+    coder->density = DEFAULT_DENSITY;
+
+    switch (coder->field) {
+        case kodoc_binary:
+            coder->field_max = 1;
+            coder->split = (const uint8_t (*)[32])gf256_split;
+            coder->inv = gf256_inv_table;
+            break;
+        case kodoc_binary4:
+            coder->field_max = 15;
+            coder->split = (const uint8_t (*)[32])gf16_split;
+            coder->inv = gf16_inv_table;
+            break;
+        default:
+            coder->field_max = 255;
+            coder->split = (const uint8_t (*)[32])gf256_split;
+            coder->inv = gf256_inv_table;
+    }
+
+    coder->data = calloc(coder->symbols, sizeof(uint8_t *));
+    coder->state = calloc(coder->symbols, sizeof(uint8_t));
+    coder->coefs = malloc(coder->symbols);
+    // holds either a symbol or a coefficient vector
+    coder->scratch = malloc(coder->symbols > coder->symbol_size ? coder->symbols : coder->symbol_size);
+    assert(coder->data != NULL && coder->state != NULL &&
+           coder->coefs != NULL && coder->scratch != NULL);
+
+    if (!coder->is_encoder) {
+        coder->matrix = malloc((size_t)coder->symbols * coder->symbols);
+        coder->coded = malloc(coder->symbols * sizeof(uint32_t));
+        assert(coder->matrix != NULL && coder->coded != NULL);
+    }
+
+    return coder;
+}
+
+void kodoc_delete_coder(kodoc_coder_t coder)
+{
+    free(coder->batch);
+    free(coder->scratch);
+    free(coder->coded);
+    free(coder->matrix);
+    free(coder->coefs);
+    free(coder->state);
+    free(coder->data);
+    free(coder);
+}
+
+void kodoc_reset_coder(kodoc_coder_t coder)
+{
+    // as kodoc_factory_build_coder() left it, minus the allocations
+    coder->rank = 0;
+    memset(coder->data, 0, coder->symbols * sizeof(uint8_t *));
+    memset(coder->state, SYMBOL_MISSING, coder->symbols);
+    coder->rng = new_seed();
+    coder->base = coder->lower = coder->consumed = coder->prefix = 0;
+    coder->systematic = coder->codec == kodoc_reed_solomon;
+    coder->next_uncoded = coder->repair = 0;
+    coder->density = DEFAULT_DENSITY;
+    coder->ncoded = coder->uncoded = 0;
+}
+
+//---------------------------------------------------------------------
+// PAYLOAD API
+//---------------------------------------------------------------------
+
+uint32_t kodoc_payload_size(kodoc_coder_t coder)
+{
+    return coder->ops->header_size(coder->field, coder->symbols) + coder->symbol_size;
+}
+
+// A payload no encoder of this decoder's settings could have written is
+// dropped, it comes off the network.
+void kodoc_read_payload(kodoc_coder_t decoder, uint8_t *payload)
+{
+    assert(!decoder->is_encoder);
+    decoder->ops->read_payload(decoder, payload);
+}
+
+uint32_t kodoc_write_payload(kodoc_coder_t coder, uint8_t *payload)
+{
+    uint32_t slot, hdrlen;
+
+    assert(coder->is_encoder);
+    hdrlen = coder->ops->write_header(coder, payload, coder->coefs, &slot);
+    if (slot < coder->symbols)
+        memcpy(payload + hdrlen, coder->data[slot], coder->symbol_size);
+    else
+        encode_symbol(coder, payload + hdrlen, coder->coefs);
+
+    return hdrlen + coder->symbol_size;
+}
+
+void kodoc_write_payloads(kodoc_coder_t encoder, uint8_t **payloads, uint32_t *sizes, uint32_t count)
+{
+    const uint32_t n = encoder->symbols;
+    uint8_t *symbols[BATCH_MAX];
+
+    assert(encoder->is_encoder);
+    if (encoder->batch == NULL) {
+        encoder->batch = malloc((size_t)BATCH_MAX * n);
+        assert(encoder->batch != NULL);
+    }
+
+    while (count > 0) {
+        uint32_t k = 0, batch = count < BATCH_MAX ? count : BATCH_MAX;
+
+        for (uint32_t i = 0; i < batch; i++) {
+            uint32_t slot, hdrlen;
+            hdrlen = encoder->ops->write_header(encoder, payloads[i], encoder->batch + (size_t)k * n, &slot);
+            sizes[i] = hdrlen + encoder->symbol_size;
+            if (slot < n)
+                memcpy(payloads[i] + hdrlen, encoder->data[slot], encoder->symbol_size);
+            else
+                symbols[k++] = payloads[i] + hdrlen;
+        }
+        if (k > 0) encode_batch(encoder, symbols, encoder->batch, k);
+
+        payloads += batch;
+        sizes += batch;
+        count -= batch;
+    }
+}
+
+uint8_t kodoc_has_write_payload(kodoc_coder_t coder)
+{
+    return coder->is_encoder;
+}
+
+//---------------------------------------------------------------------
+// SYMBOL STORAGE API
+//---------------------------------------------------------------------
+
+uint32_t kodoc_block_size(kodoc_coder_t coder)
+{
+    return coder->symbols * coder->symbol_size;
+}
+
+void kodoc_set_const_symbols(kodoc_coder_t encoder, uint8_t *data, uint32_t size)
+{
+    for (uint32_t i = 0; i < encoder->symbols && size > 0; i++) {
+        assert(size >= encoder->symbol_size); // partial symbols need their own buffer
+        kodoc_set_const_symbol(encoder, i, data, encoder->symbol_size);
+        data += encoder->symbol_size; size -= encoder->symbol_size;
+    }
+}
+
+void kodoc_set_const_symbol(kodoc_coder_t encoder, uint32_t index, uint8_t *data, uint32_t size)
+{
+    assert(encoder->is_encoder && size == encoder->symbol_size);
+    // a sliding window only grows at its upper edge and needs a free slot
+    assert(!encoder->window || (index == encoder->rank && index - encoder->base < encoder->symbols));
+
+    uint32_t slot = encoder->window ? index % encoder->symbols : index;
+    assert(slot < encoder->symbols);
+
+    encoder->data[slot] = data;
+    if (encoder->state[slot] == SYMBOL_MISSING) {
+        encoder->state[slot] = SYMBOL_UNCODED;
+        encoder->rank++;
+    }
+}
+
+void kodoc_set_mutable_symbols(kodoc_coder_t decoder, uint8_t *data, uint32_t size)
+{
+    assert(size >= decoder->symbols * decoder->symbol_size);
+    for (uint32_t i = 0; i < decoder->symbols; i++)
+        decoder->data[i] = data + (size_t)i * decoder->symbol_size;
+}
+
+void kodoc_set_mutable_symbol(kodoc_coder_t decoder, uint32_t index, uint8_t *data, uint32_t size)
+{
+    assert(index < decoder->symbols && size == decoder->symbol_size);
+    decoder->data[index] = data;
+}
+
+uint32_t kodoc_symbol_size(kodoc_coder_t coder)
+{
+    return coder->symbol_size;
+}
+
+uint32_t kodoc_symbols(kodoc_coder_t coder)
+{
+    return coder->symbols;
+}
+
+uint32_t kodoc_coefficient_vector_size(kodoc_coder_t coder)
+{
+    return coder->vector_size;
+}
+
+//---------------------------------------------------------------------
+// CODEC API
+//---------------------------------------------------------------------
+
+uint8_t kodoc_is_complete(kodoc_coder_t decoder)
+{
+    // a stream is never complete
+    return !decoder->window && decoder->rank == decoder->symbols;
+}
+
+uint8_t kodoc_has_partial_decoding_interface(kodoc_coder_t decoder)
+{
+    return !decoder->is_encoder;
+}
+
+uint8_t kodoc_is_partially_complete(kodoc_coder_t decoder)
+{
+    return decoder->uncoded > 0;
+}
+
+uint32_t kodoc_rank(kodoc_coder_t coder)
+{
+    if (coder->window && !coder->is_encoder) return coder->prefix;
+    return coder->rank;
+}
+
+static inline uint8_t symbol_state(kodoc_coder_t decoder, uint32_t index)
+{
+    uint32_t slot = slot_of(decoder, index);
+    return slot < decoder->symbols ? decoder->state[slot] : SYMBOL_MISSING;
+}
+
+uint8_t kodoc_is_symbol_pivot(kodoc_coder_t decoder, uint32_t index)
+{
+    return symbol_state(decoder, index) != SYMBOL_MISSING;
+}
+
+uint8_t kodoc_is_symbol_missing(kodoc_coder_t decoder, uint32_t index)
+{
+    return symbol_state(decoder, index) == SYMBOL_MISSING;
+}
+
+uint8_t kodoc_is_symbol_partially_decoded(kodoc_coder_t decoder, uint32_t index)
+{
+    return symbol_state(decoder, index) == SYMBOL_CODED;
+}
+
+uint8_t kodoc_is_symbol_uncoded(kodoc_coder_t decoder, uint32_t index)
+{
+    return symbol_state(decoder, index) == SYMBOL_UNCODED;
+}
+
+uint32_t kodoc_symbols_missing(kodoc_coder_t decoder)
+{
+    return decoder->symbols - decoder->rank;
+}
+
+uint32_t kodoc_symbols_partially_decoded(kodoc_coder_t decoder)
+{
+    return decoder->ncoded;
+}
+
+uint32_t kodoc_symbols_uncoded(kodoc_coder_t decoder)
+{
+    return decoder->uncoded;
+}
+
+void kodoc_read_symbol(kodoc_coder_t decoder, uint8_t *symbol_data, uint8_t *coefficients)
+{
+    assert(!decoder->is_encoder);
+    unpack_vector(decoder, decoder->coefs, coefficients);
+    decode_symbol(decoder, decoder->coefs, symbol_data);
+}
+
+void kodoc_read_uncoded_symbol(kodoc_coder_t decoder, uint8_t *symbol_data, uint32_t index)
+{
+    uint32_t slot = slot_of(decoder, index);
+    assert(!decoder->is_encoder);
+    if (slot < decoder->symbols) decode_uncoded(decoder, symbol_data, slot);
+    if (decoder->window) window_advance(decoder);
+}
+
+uint32_t kodoc_write_symbol(kodoc_coder_t encoder, uint8_t *symbol_data, uint8_t *coefficients)
+{
+    assert(encoder->is_encoder);
+    unpack_vector(encoder, encoder->coefs, coefficients);
+    encode_symbol(encoder, symbol_data, encoder->coefs);
+    return encoder->symbol_size;
+}
+
+uint32_t kodoc_write_uncoded_symbol(kodoc_coder_t encoder, uint8_t *symbol_data, uint32_t index)
+{
+    uint32_t slot = slot_of(encoder, index);
+    assert(encoder->is_encoder && slot < encoder->symbols && encoder->state[slot] != SYMBOL_MISSING);
+    memcpy(symbol_data, encoder->data[slot], encoder->symbol_size);
+    return encoder->symbol_size;
+}
+
+//---------------------------------------------------------------------
+// SYSTEMATIC API
+//---------------------------------------------------------------------
+
+uint8_t kodoc_has_systematic_interface(kodoc_coder_t encoder)
+{
+    return encoder->is_encoder;
+}
+
+uint8_t kodoc_is_systematic_on(kodoc_coder_t encoder)
+{
+    return encoder->systematic;
+}
+
+void kodoc_set_systematic_on(kodoc_coder_t encoder)
+{
+    assert(encoder->is_encoder);
+    encoder->systematic = 1;
+}
+
+void kodoc_set_systematic_off(kodoc_coder_t encoder)
+{
+    assert(encoder->is_encoder);
+    // Reed-Solomon repairs assume the receiver saw the source symbols
+    if (encoder->codec != kodoc_reed_solomon) encoder->systematic = 0;
+}
+
+//---------------------------------------------------------------------
+// FEEDBACK API
+//---------------------------------------------------------------------
+
+uint8_t kodoc_has_feedback_size(kodoc_coder_t coder)
+{
+    return coder->window;
+}
+
+uint8_t kodoc_feedback_size(kodoc_coder_t coder)
+{
+    return coder->window ? sizeof(uint32_t) : 0;
+}
+
+void kodoc_read_feedback(kodoc_coder_t encoder, uint8_t *feedback)
+{
+    uint32_t lower;
+    assert(encoder->is_encoder && encoder->window);
+    memcpy(&lower, feedback, sizeof(lower));
+    window_slide_encoder(encoder, lower);
+}
+
+uint32_t kodoc_write_feedback(kodoc_coder_t decoder, uint8_t *feedback)
+{
+    assert(!decoder->is_encoder && decoder->window);
+    memcpy(feedback, &decoder->prefix, sizeof(decoder->prefix));
+    return sizeof(decoder->prefix);
+}
+
+//---------------------------------------------------------------------
+// SLIDING WINDOW API
+//---------------------------------------------------------------------
+
+void kodoc_release_symbols(kodoc_coder_t decoder, uint32_t index)
+{
+    assert(!decoder->is_encoder && decoder->window);
+    if (index > decoder->consumed) decoder->consumed = index;
+    window_advance(decoder);
+}
+
+uint32_t kodoc_window_lower(kodoc_coder_t coder)
+{
+    return coder->base;
+}
+
+//---------------------------------------------------------------------
+// SPARSE ENCODER API
+//---------------------------------------------------------------------
+
+double kodoc_density(kodoc_coder_t encoder)
+{
+    return encoder->density;
+}
+
+void kodoc_set_density(kodoc_coder_t encoder, double density)
+{
+    assert(encoder->is_encoder && density > 0.0 && density <= 1.0);
+    encoder->density = density;
+}